@@ -0,0 +1,60 @@
+/*
+ * Word count application that picks how to count for you.
+ *
+ * It takes the options and files of the other frontends, plans with
+ * word_engine which of them suits the input, the CPUs and the memory at
+ * hand, says on stderr what it chose and why, and then runs that frontend,
+ * found next to itself, with the chosen table and options added in front of
+ * its own.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "word_engine.h"
+#include "word_options.h"
+
+int main(int argc, char *argv[]) {
+    struct word_engine_plan plan;
+    char path[PATH_MAX], backend[64];
+    const char *program, *slash;
+    char **args;
+    int first, n = 0;
+
+    if ((first = word_options_parse(argc, argv)) < 0) {
+        return 1;
+    }
+    word_engine_plan(&plan, argv + first, argc - first);
+    word_engine_print(stderr, argv[0], &plan);
+
+    program = word_engine_program(plan.engine);
+    if ((slash = strrchr(argv[0], '/')) != NULL) {
+        snprintf(path, sizeof(path), "%.*s/%s", (int) (slash - argv[0]),
+                 argv[0], program);
+    } else {
+        snprintf(path, sizeof(path), "%s", program);
+    }
+
+    /* The frontend, our choices, then our arguments and their NULL. */
+    if ((args = malloc((argc + 3) * sizeof(char *))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    args[n++] = path;
+    if (word_options_backend == NULL) {
+        snprintf(backend, sizeof(backend), "--backend=%s", plan.backend);
+        args[n++] = backend;
+    }
+    if (plan.engine == ENGINE_CHUNKS && word_options_pipeline.readers == 0) {
+        args[n++] = "--pipeline";
+    }
+    memcpy(args + n, argv + 1, argc * sizeof(char *));
+
+    fflush(stderr);
+    execvp(path, args);
+    perror(path);
+    return 1;
+}
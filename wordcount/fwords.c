@@ -29,10 +29,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 
+#include "word_aio.h"
+#include "word_backend.h"
 #include "word_count.h"
 #include "word_helpers.h"
+#include "word_hll.h"
+#include "word_options.h"
+#include "word_progress.h"
+#include "word_stats.h"
+#include "word_trace.h"
 /*
     fork seperate child process for each file. Merge output of each process into final output
     each child process sends output to parent via pipe and parent uses merge_counts to merge results
@@ -49,7 +57,9 @@ void merge_counts(word_count_list_t *wclist, FILE *count_stream) {
     char *word;
     int count;
     int rv;
-    while ((rv = fscanf(count_stream, "%8d\t%ms\n", &count, &word)) == 2)
+    struct word_timer t;
+    word_timer_start(&t);
+    while ((rv = fscanf(count_stream, "%8d\t%m[^\n]\n", &count, &word)) == 2)
     {
         add_word_with_count(wclist, word, count);\
     }
@@ -58,6 +68,7 @@ void merge_counts(word_count_list_t *wclist, FILE *count_stream) {
     } else if (rv != EOF) {
         fprintf(stderr, "read ill-formed count (matched %d)\n", rv);
     }
+    word_timer_stop(&t, PHASE_MERGE);
 }
 
 /*
@@ -66,16 +77,49 @@ void merge_counts(word_count_list_t *wclist, FILE *count_stream) {
 int main(int argc, char *argv[]) {
     /* Create the empty data structure. */
     word_count_list_t word_counts;
+    struct word_timer t;
+    int first;
+
+    if ((first = word_options_parse(argc, argv)) < 0 ||
+        !word_backend_select(argv[0], word_options_backend, "pintos")) {
+        return 1;
+    }
     init_words(&word_counts);
+    if (word_options_pipeline.readers > 0) {
+        fprintf(stderr, "%s: --pipeline is only supported by pwords\n",
+                argv[0]);
+        return 1;
+    }
+    if (word_options_numa) {
+        fprintf(stderr, "%s: --numa is only supported by pwords\n", argv[0]);
+        return 1;
+    }
+    /* Children see their file at argv[i] for i in [1, argc). */
+    argv += first - 1;
+    argc -= first - 1;
+    word_progress_begin(argv + 1, argc - 1);
+    word_progress_watch(&word_counts, 1);
 
     if (argc <= 1) {
         /* Process stdin in a single process. */
         count_words(&word_counts, stdin);
+        word_progress_end();
     } else {
         /* Process each file in a separate process. */
         int i;
         //use multiple pipes because one pipe is not enough
         int pipefds[argc - 1][2];
+        //a snapshot asked of the parent is taken by every child
+        pid_t pids[argc - 1];
+        //children leave the sketch of their file here, for the total
+        struct word_hll *sketches = NULL;
+        if (word_hll_enabled &&
+            (sketches = mmap(NULL, (argc - 1) * sizeof(struct word_hll),
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                             -1, 0)) == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
         
         /* Process each file in a separate process. */
         for (i = 1; i < argc; i++) {
@@ -87,32 +131,60 @@ int main(int argc, char *argv[]) {
             if (pid == 0) {
                 /* Child process. */
                 close(pipefds[i-1][0]); 
+                word_progress_child(i);
+                word_trace_child(i);
                 
-                FILE *infile = fopen(argv[i], "r");
-                if (infile == NULL) {
+                FILE *infile = NULL;
+                if (word_options_aio < 0 &&
+                    (infile = fopen(argv[i], "r")) == NULL) {
                     perror("fopen");
                     exit(1);
                 }
-                printf("child process %d started\n", i);
-                count_words(&word_counts, infile);
-                fclose(infile);
+                if (word_stats_enabled) {
+                    fprintf(stderr, "fwords: child process %d started\n", i);
+                }
+                if (infile != NULL) {
+                    count_words(&word_counts, infile);
+                    fclose(infile);
+                } else {
+                    /* Overlap reading this child's file with counting it. */
+                    struct word_aio *aio = word_aio_start(&argv[i], 1, 1);
+                    if (aio == NULL) {
+                        exit(1);
+                    }
+                    word_aio_claim(aio);
+                    count_words_source(&word_counts, word_aio_source(aio, 0));
+                    word_aio_finish(aio);
+                }
+                if (sketches != NULL && word_hll_input != NULL) {
+                    sketches[i-1] = *word_hll_input;
+                    word_hll_print_input(stderr, argv[i]);
+                }
 
                 FILE *pipe_out = fdopen(pipefds[i-1][1], "w");
                 if (pipe_out == NULL) {
                     perror("fdopen");
-                    fclose(infile); 
                     exit(1);
                 }
 
                 fprint_words(&word_counts, pipe_out);
                 fflush(pipe_out); 
+                {
+                    char label[64];
+                    snprintf(label, sizeof(label), "child %d", i);
+                    word_stats_print(stderr, label, len_words(&word_counts),
+                                     bytes_words(&word_counts));
+                }
                 fclose(pipe_out);
                 close(pipefds[i-1][1]); 
+                word_trace_write();
                 exit(0);
             } else {
                 close(pipefds[i-1][1]); 
+                pids[i-1] = pid;
             }
         }
+        word_progress_forward(pids, argc - 1);
         
         
         
@@ -126,16 +198,35 @@ int main(int argc, char *argv[]) {
             fclose(pipe_stream); // Don't forget to close the stream
         }
 
+        //stop forwarding before the children's pids can be reused
+        word_progress_end();
         //clean up to avoid zombie processes
         for (i = 1; i < argc; i++) {
             wait(NULL); 
         }
+        if (sketches != NULL) {
+            for (i = 1; i < argc; i++) {
+                word_hll_add_total(&sketches[i-1]);
+            }
+            munmap(sketches, (argc - 1) * sizeof(struct word_hll));
+        }
     }
 
 
     /* Output final result of all process' work. */
-    printf("len_words: %d\n", len_words(&word_counts));
+    if (word_stats_enabled) {
+        fprintf(stderr, "fwords: %zu unique words\n",
+                len_words(&word_counts));
+    }
+    word_timer_start(&t);
     wordcount_sort(&word_counts, less_count);
+    word_timer_stop(&t, PHASE_SORT);
+    word_timer_start(&t);
     fprint_words(&word_counts, stdout);
+    word_timer_stop(&t, PHASE_OUTPUT);
+    word_stats_print(stderr, "fwords", len_words(&word_counts),
+                     bytes_words(&word_counts));
+    word_hll_print_total(stderr, len_words(&word_counts));
+    word_trace_write();
     return 0;
 }
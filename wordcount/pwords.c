@@ -28,50 +28,203 @@
  #include <stdio.h>
  #include <stdlib.h>
  #include <string.h>
+ #include <unistd.h>
  
+ #include "word_aio.h"
+ #include "word_backend.h"
  #include "word_count.h"
  #include "word_helpers.h"
+ #include "word_hll.h"
+ #include "word_io.h"
+ #include "word_numa.h"
+ #include "word_options.h"
+ #include "word_pipeline.h"
+ #include "word_progress.h"
+ #include "word_stats.h"
+ #include "word_trace.h"
  
  // Struct to hold arguments for each thread
  typedef struct {
      word_count_list_t *word_counts; 
      char *filename;                
+     struct word_numa *numa; // with --numa, word_counts has one list per node
+     int worker;
  } thread_args_t;
  
+ /*
+  * Returns the list worker WORKER should count into. With NUMA placement the
+  * worker is first pinned to a node, and counts into that node's list, so the
+  * entries it allocates come from the node's own memory.
+  */
+ word_count_list_t *worker_counts(word_count_list_t *word_counts,
+                                  struct word_numa *numa, int worker) {
+     if (numa == NULL) {
+         return word_counts;
+     }
+     return &word_counts[word_numa_place(numa, worker)];
+ }
+ 
  // Wrapper function for count_words to be used with pthread_create
  void *count_words_wrapper(void *args) {
      // Extract arguments from the struct
      thread_args_t *targs = (thread_args_t *)args;
+     word_trace_thread("file %d", targs->worker);
+     uint64_t start = word_trace_begin();
      FILE *infile = fopen(targs->filename, "r");
+     word_trace_end("open", start);
  
      // Check if file opened successfully
      if (infile == NULL) {
          perror("fopen");
          return NULL;
      }
-     count_words(targs->word_counts, infile); 
+     count_words(worker_counts(targs->word_counts, targs->numa, targs->worker),
+                 infile);
      fclose(infile);
+     word_hll_print_input(stderr, targs->filename);
      free(targs);
      pthread_exit(NULL);
  }
  
+ // With --aio, workers claim files from a shared reader instead
+ typedef struct {
+     word_count_list_t *word_counts;
+     struct word_aio *aio;
+     struct word_numa *numa;
+     int next_worker;
+ } aio_args_t;
+ 
+ void *aio_worker(void *args) {
+     aio_args_t *aargs = (aio_args_t *)args;
+     int worker = __atomic_fetch_add(&aargs->next_worker, 1, __ATOMIC_RELAXED);
+     word_count_list_t *counts =
+         worker_counts(aargs->word_counts, aargs->numa, worker);
+     int file;
+ 
+     word_trace_thread("worker %d", worker);
+     while ((file = word_aio_claim(aargs->aio)) >= 0) {
+         count_words_source(counts, word_aio_source(aargs->aio, file));
+     }
+     if (word_hll_enabled) {
+         char name[32];
+         snprintf(name, sizeof(name), "worker %d", worker);
+         word_hll_print_worker(stderr, name);
+     }
+     return NULL;
+ }
+
+ /*
+  * Counts FILES with a pool of WORKERS threads fed by asynchronous reads, so
+  * many small files do not each cost a thread and a blocking open/read.
+  */
+ void count_files_aio(word_count_list_t *word_counts, char *files[], int nfiles,
+                      int workers, struct word_numa *numa) {
+     struct word_aio *aio;
+
+     if (workers == 0) {
+         workers = word_numa_cpus();
+     }
+     if (workers > nfiles) {
+         workers = nfiles;
+     }
+     if ((aio = word_aio_start(files, nfiles, workers)) == NULL) {
+         exit(1);
+     }
+     if (word_stats_enabled) {
+         fprintf(stderr, "pwords: %d workers reading with %s\n", workers,
+                 word_aio_uses_uring(aio) ? "io_uring" : "pread");
+     }
+
+     pthread_t threads[workers];
+     aio_args_t aargs = {word_counts, aio, numa, 0};
+     for (int i = 0; i < workers; i++) {
+         if (pthread_create(&threads[i], NULL, aio_worker, &aargs)) {
+             perror("pthread_create did not succeed");
+             exit(1);
+         }
+     }
+     for (int i = 0; i < workers; i++) {
+         pthread_join(threads[i], NULL);
+     }
+     word_aio_finish(aio);
+ }
+
+ /*
+  * Moves the counts of the NNODES per-node lists in NODES into WORD_COUNTS,
+  * which must be empty.
+  */
+ void merge_nodes(word_count_list_t *word_counts, word_count_list_t nodes[],
+                  int nnodes) {
+     struct word_timer t;
+ 
+     word_timer_start(&t);
+     for (int i = 0; i < nnodes; i++) {
+         merge_words(word_counts, &nodes[i], false);
+     }
+     word_timer_stop(&t, PHASE_MERGE);
+ }
+ 
  /*
   * main - handle command line, spawning one thread per file.
   */
  int main(int argc, char *argv[]) {
      /* Create the empty data structure. */
      word_count_list_t word_counts;
+     struct word_timer t;
+     struct word_numa *numa = NULL;
+     word_count_list_t *counts = &word_counts;
+     int first;
+ 
+     if ((first = word_options_parse(argc, argv)) < 0 ||
+         !word_backend_select(argv[0], word_options_backend, "locked")) {
+         return 1;
+     }
      init_words(&word_counts);
+     if (word_options_numa && first < argc) {
+         // On a single node there is nothing to place
+         if ((numa = word_numa_detect()) != NULL) {
+             int nnodes = word_numa_nodes(numa);
+             if ((counts = malloc(nnodes * sizeof(word_count_list_t))) == NULL) {
+                 perror("malloc");
+                 exit(1);
+             }
+             for (int i = 0; i < nnodes; i++) {
+                 init_words(&counts[i]);
+             }
+         }
+         if (word_stats_enabled) {
+             fprintf(stderr, "pwords: %d NUMA node%s, placement %s\n",
+                     numa ? word_numa_nodes(numa) : 1, numa ? "s" : "",
+                     numa ? "on" : "off");
+         }
+     }
+ 
+     word_progress_begin(argv + first, argc - first);
+     word_progress_watch(counts, numa ? word_numa_nodes(numa) : 1);
  
-     if (argc <= 1) {
-         /* Process stdin in a single thread. */
+     if (first >= argc && word_io_mode != WORD_IO_STDIO) {
+         /* Read stdin the way --io asked, in a single thread. */
          count_words(&word_counts, stdin);
+     } else if (first >= argc) {
+         /* Cut stdin into chunks for a pipeline of worker threads. */
+         struct word_pipeline_config config = word_options_pipeline;
+         if (config.readers == 0) {
+             word_pipeline_default(&config);
+         }
+         count_stream_pipeline(&word_counts, STDIN_FILENO, &config);
+     } else if (word_options_pipeline.readers > 0) {
+         count_files_pipeline(&word_counts, argv + first, argc - first,
+                              &word_options_pipeline);
+     } else if (word_options_aio >= 0) {
+         count_files_aio(counts, argv + first, argc - first,
+                         word_options_aio, numa);
      } else {
          // Initialize threads
-         pthread_t threads[argc - 1];
+         int nfiles = argc - first;
+         pthread_t threads[nfiles];
  
          // Go through each file
-         for (int i = 1; i < argc; i++) {
+         for (int i = 0; i < nfiles; i++) {
              // Allocate memory for thread arguments
              thread_args_t *targs = malloc(sizeof(thread_args_t));
              if (targs == NULL) {
@@ -80,11 +233,13 @@
              }
  
              // Set up the thread arguments
-             targs->word_counts = &word_counts;
-             targs->filename = argv[i];
+             targs->word_counts = counts;
+             targs->filename = argv[first + i];
+             targs->numa = numa;
+             targs->worker = i;
  
              // Create the thread
-             if (pthread_create(&threads[i - 1], NULL, count_words_wrapper, (void *)targs)) {
+             if (pthread_create(&threads[i], NULL, count_words_wrapper, (void *)targs)) {
                  perror("pthread_create did not succeed");
                  free(targs);
                  exit(1);
@@ -92,13 +247,29 @@
          }
  
          // Join the threads to continue executing main
-         for (int i = 0; i < argc - 1; i++) {
+         for (int i = 0; i < nfiles; i++) {
              pthread_join(threads[i], NULL);
          }
      }
+     word_progress_end();
+     if (numa != NULL) {
+         word_progress_watch(&word_counts, 1);
+         merge_nodes(&word_counts, counts, word_numa_nodes(numa));
+         word_numa_free(numa);
+         free(counts);
+     }
  
+     word_timer_start(&t);
      wordcount_sort(&word_counts, less_count);
+     word_timer_stop(&t, PHASE_SORT);
+     word_timer_start(&t);
      fprint_words(&word_counts, stdout);
+     word_timer_stop(&t, PHASE_OUTPUT);
+     word_stats_print(stderr, argv[0], len_words(&word_counts),
+                      bytes_words(&word_counts));
+     word_hll_print_total(stderr, len_words(&word_counts));
+     word_lock_stats_print(stderr);
+     word_trace_write();
  
      return 0;
  }
\ No newline at end of file
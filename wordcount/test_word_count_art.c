@@ -0,0 +1,189 @@
+/*
+ * Tests of the adaptive radix tree backend. The tree's nodes are internal
+ * to word_count_art.c, so it is included here rather than linked, and the
+ * tests can look at the node types and prefixes the words produce.
+ */
+
+#include "word_count_art.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The node type the root should have once it has N children. */
+static enum art_type type_for(int n) {
+    return n <= 4 ? NODE4 : n <= 16 ? NODE16 : n <= 48 ? NODE48 : NODE256;
+}
+
+/* Whether WCLIST holds WORD with COUNT. */
+static bool counted(word_count_list_t *wclist, const char *word, int count) {
+    const word_count_t *wc = find_word(wclist, (char *) word);
+    return wc != NULL && wc->count == count && strcmp(wc_word(wc), word) == 0;
+}
+
+/* Words "x" followed by byte K, or just "x" for K = 0. */
+static void branch_word(char word[3], int k) {
+    word[0] = 'x';
+    word[1] = k;
+    word[2] = '\0';
+}
+
+/* Fills one node with all 256 branch bytes, in a scrambled order, checking
+ * that it grows at 5, 17 and 49 children and loses no word on the way. */
+void test_art_growth() {
+    word_count_list_t wclist;
+    bool passed = true;
+    char word[3];
+    int n, i;
+
+    init_words(&wclist);
+    add_word(&wclist, strdup("x"));
+    for (n = 1; n < 256; n++) {
+        branch_word(word, (n * 167) % 256);
+        add_word(&wclist, strdup(word));
+        passed &= len_words(&wclist) == (size_t) n + 1;
+        passed &= !IS_LEAF(wclist.root) &&
+                  ((struct art_node *) wclist.root)->type == type_for(n + 1);
+        passed &= ((struct art_node *) wclist.root)->num_children ==
+                  (uint8_t) (n + 1);
+        for (i = 0; i <= n; i++) {
+            branch_word(word, (i * 167) % 256);
+            passed &= counted(&wclist, word, 1);
+        }
+    }
+    for (i = 0; i < 256; i++) {
+        branch_word(word, i);
+        add_word(&wclist, strdup(word));
+        passed &= counted(&wclist, word, 2);
+    }
+    passed &= find_word(&wclist, "xx\x01") == NULL &&
+              find_word(&wclist, "y") == NULL;
+
+    printf("test_art_growth: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* A shared prefix longer than ART_MAX_PREFIX is kept only in part; words
+ * that leave it before and after the stored bytes must split it right. */
+void test_art_split_prefix() {
+    word_count_list_t wclist;
+    struct art_node *root;
+    bool passed = true;
+
+    init_words(&wclist);
+    add_word(&wclist, strdup("abcdefghijklmnop1"));
+    add_word(&wclist, strdup("abcdefghijklmnop2"));
+    root = wclist.root;
+    passed &= root->prefix_len == 16;
+
+    /* Leaves the prefix past its stored part, where the leaf is read. */
+    add_word_with_count(&wclist, strdup("abcdefghijklXYZ"), 3);
+    root = wclist.root;
+    passed &= root->type == NODE4 && root->prefix_len == 12 &&
+              root->num_children == 2;
+    /* Leaves it inside the stored part. */
+    add_word_with_count(&wclist, strdup("abcdeQ"), 4);
+    root = wclist.root;
+    passed &= root->prefix_len == 5 && memcmp(root->prefix, "abcde", 5) == 0;
+
+    passed &= counted(&wclist, "abcdefghijklmnop1", 1) &&
+              counted(&wclist, "abcdefghijklmnop2", 1) &&
+              counted(&wclist, "abcdefghijklXYZ", 3) &&
+              counted(&wclist, "abcdeQ", 4);
+    passed &= find_word(&wclist, "abcdefghijklmnop3") == NULL &&
+              find_word(&wclist, "abcdefghijklmnop") == NULL &&
+              find_word(&wclist, "abcdefghijkl") == NULL &&
+              find_word(&wclist, "abcdefghijklmnopq") == NULL &&
+              find_word(&wclist, "abcde") == NULL;
+
+    /* The split node still grows and answers below its shortened prefix. */
+    add_word(&wclist, strdup("abcdefghijklmnop3"));
+    add_word(&wclist, strdup("abcdefghijklmnop1"));
+    passed &= counted(&wclist, "abcdefghijklmnop3", 1) &&
+              counted(&wclist, "abcdefghijklmnop1", 2) &&
+              len_words(&wclist) == 5;
+
+    printf("test_art_split_prefix: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* Words that are prefixes of other words end at the NUL branch of a node,
+ * whichever of them comes first. */
+void test_art_prefix_of_word() {
+    const char *words[] = {"abcde", "a", "abc", "ab", "abcd"};
+    size_t n = sizeof(words) / sizeof(words[0]);
+    word_count_list_t wclist;
+    bool passed = true;
+    size_t i;
+
+    init_words(&wclist);
+    for (i = 0; i < n; i++) {
+        add_word_with_count(&wclist, strdup(words[i]), i + 1);
+    }
+    for (i = n; i-- > 0;) {
+        add_word(&wclist, strdup(words[i]));
+    }
+    for (i = 0; i < n; i++) {
+        passed &= counted(&wclist, words[i], i + 2);
+    }
+    passed &= len_words(&wclist) == n;
+    passed &= find_word(&wclist, "") == NULL &&
+              find_word(&wclist, "abcdef") == NULL &&
+              find_word(&wclist, "b") == NULL;
+
+    printf("test_art_prefix_of_word: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* Appends the word of WC, then a space, to the string AUX. */
+static void append_word(const word_count_t *wc, void *aux) {
+    strcat(aux, wc_word(wc));
+    strcat(aux, " ");
+}
+
+/* Whether prefix_words on PREFIX visits exactly EXPECTED, in that order. */
+static bool visits(word_count_list_t *wclist, const char *prefix,
+                   const char *expected) {
+    char seen[256] = "";
+    prefix_words(wclist, prefix, append_word, seen);
+    return strcmp(seen, expected) == 0;
+}
+
+void test_art_prefix_words() {
+    const char *words[] = {"cars", "card",   "dog",  "car", "cared",
+                           "cat",  "carbon", "care", "do"};
+    size_t n = sizeof(words) / sizeof(words[0]);
+    word_count_list_t wclist;
+    bool passed = true;
+    size_t i;
+
+    init_words(&wclist);
+    passed &= visits(&wclist, "", "") && visits(&wclist, "car", "");
+    for (i = 0; i < n; i++) {
+        add_word(&wclist, strdup(words[i]));
+    }
+    passed &= visits(&wclist, "", "car carbon card care cared cars cat do dog ");
+    passed &= visits(&wclist, "car", "car carbon card care cared cars ");
+    passed &= visits(&wclist, "care", "care cared ");
+    passed &= visits(&wclist, "cared", "cared ");
+    passed &= visits(&wclist, "do", "do dog ");
+    passed &= visits(&wclist, "c", "car carbon card care cared cars cat ");
+    passed &= visits(&wclist, "x", "") && visits(&wclist, "cab", "") &&
+              visits(&wclist, "carex", "") && visits(&wclist, "dogs", "");
+
+    /* Through a prefix longer than the stored part. */
+    init_words(&wclist);
+    add_word(&wclist, strdup("abcdefghijklmnop1"));
+    add_word(&wclist, strdup("abcdefghijklmnop2"));
+    passed &= visits(&wclist, "abcdefghijklm",
+                     "abcdefghijklmnop1 abcdefghijklmnop2 ");
+    passed &= visits(&wclist, "abcdefghijklX", "") &&
+              visits(&wclist, "abcdefghijklmnop3", "");
+
+    printf("test_art_prefix_words: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+int main() {
+    test_art_growth();
+    test_art_split_prefix();
+    test_art_prefix_of_word();
+    test_art_prefix_words();
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "word_count.h"
+#include "word_helpers.h"
 
 void test_init_words() {
     word_count_list_t word_counts;
@@ -12,42 +13,270 @@ void test_len_words() {
     word_count_list_t wclist;
     init_words(&wclist);
 
-    
+    add_word(&wclist, strdup("one"));
+    add_word(&wclist, strdup("two"));
+    add_word(&wclist, strdup("one"));
 
+    if (len_words(&wclist) == 2) {
+        printf("test_len_words: PASSED\n");
+    } else {
+        printf("test_len_words: FAILED\n");
+    }
 }
 
-// void test_find_word() {
-//     word_count_list_t wclist;
-//     init_words(&wclist);
+void test_find_word() {
+    word_count_list_t wclist;
+    init_words(&wclist);
+
+    add_word(&wclist, strdup("test"));
+    const word_count_t *wc = find_word(&wclist, "test");
+
+    if (wc != NULL && strcmp(wc_word(wc), "test") == 0) {
+        printf("test_find_word: PASSED\n");
+    } else {
+        printf("test_find_word: FAILED\n");
+    }
+}
+
+void test_add_word() {
+    word_count_list_t wclist;
+    init_words(&wclist);
+
+    add_word(&wclist, strdup("example"));
+    const word_count_t *wc = find_word(&wclist, "example");
+
+    if (wc != NULL && strcmp(wc_word(wc), "example") == 0 && wc->count == 1) {
+        printf("test_add_word: PASSED\n");
+    } else {
+        printf("test_add_word: FAILED\n");
+    }
+}
+
+/* Short words are stored inline and long ones out of line; both must be
+ * found and must sort in strcmp order against each other. */
+void test_inline_keys() {
+    const char *words[] = {"a", "ab", "abcdefgh", "abcdefghi",
+                           "abcdefghijklmno", "abcdefghijklmnop",
+                           "abcdefghijklmnopq", "b", "zz"};
+    size_t n = sizeof(words) / sizeof(words[0]);
+    word_count_list_t wclist;
+    bool passed = true;
+    size_t i, j;
+
+    init_words(&wclist);
+    for (i = n; i-- > 0;) {
+        add_word(&wclist, strdup(words[i]));
+    }
+    for (i = 0; i < n; i++) {
+        const word_count_t *wc = find_word(&wclist, (char *) words[i]);
+        passed &= wc != NULL && strcmp(wc_word(wc), words[i]) == 0;
+    }
+    passed &= find_word(&wclist, "abcdefghijklmn") == NULL;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            const word_count_t *a = find_word(&wclist, (char *) words[i]);
+            const word_count_t *b = find_word(&wclist, (char *) words[j]);
+            int expected = strcmp(words[i], words[j]);
+            int actual = wc_compare_words(a, b);
+            passed &= (expected < 0) == (actual < 0) &&
+                      (expected > 0) == (actual > 0);
+        }
+    }
+
+    wordcount_sort(&wclist, less_word);
+    i = 0;
+    for (struct list_elem *e = list_begin(&wclist.lst);
+         e != list_end(&wclist.lst); e = list_next(e)) {
+        passed &= strcmp(wc_word(list_entry(e, word_count_t, elem)),
+                         words[i++]) == 0;
+    }
+
+    printf("test_inline_keys: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* Counts TEXT with the UTF-8 tokenizer into WCLIST. */
+static void count_utf8(word_count_list_t *wclist, const char *text) {
+    FILE *infile = fmemopen((void *) text, strlen(text), "r");
+    init_words(wclist);
+    count_words_mode = TOKENIZE_UTF8;
+    count_words(wclist, infile);
+    count_words_mode = TOKENIZE_ASCII;
+    fclose(infile);
+}
+
+/* Whether WCLIST counted WORD COUNT times. */
+static bool counted(word_count_list_t *wclist, const char *word, int count) {
+    const word_count_t *wc = find_word(wclist, (char *) word);
+    return wc != NULL && wc->count == count;
+}
 
-//     add_word(&wclist, strdup("test"));
-//     word_count_t *wc = find_word(&wclist, "test");
+/* Invalid and overlong sequences, surrogates and lead bytes past 0xf4 end a
+ * word rather than joining it to the next; letters fold across scripts. */
+void test_utf8_words() {
+    word_count_list_t wclist;
+    bool passed = true;
+
+    count_utf8(&wclist, "ab\xf8\x80\x80" "cd "      /* lead past 0xf4 */
+                        "ef\xc0\xafgh "              /* overlong 2 bytes */
+                        "ij\xe0\x80\xafkl "          /* overlong 3 bytes */
+                        "mn\xed\xa0\x80op "          /* surrogate */
+                        "qr\xf0\x80\x80\xafst "      /* overlong 4 bytes */
+                        "uv\xf4\x90\x80\x80wx "      /* past U+10FFFF */
+                        "yz\x80\xbfza");             /* stray continuations */
+    passed &= len_words(&wclist) == 14;
+    passed &= counted(&wclist, "ab", 1) && counted(&wclist, "cd", 1) &&
+              counted(&wclist, "mn", 1) && counted(&wclist, "za", 1);
+
+    count_utf8(&wclist, "\xc8\x98\xc8\x9a\xc4\x83 "  /* ȘȚă */
+                        "\xc8\x99\xc8\x9b\xc4\x82 "  /* șțĂ */
+                        "\xc3\x89t\xc3\x89 "         /* ÉtÉ */
+                        "\xce\xa3\xce\x9f\xce\xa6\xce\x99\xce\x91 " /* ΣΟΦΙΑ */
+                        "\xd0\x9c\xd0\xb8\xd1\x80 "  /* Мир */
+                        "\xd0\xbc\xd0\xb8\xd1\x80 "  /* мир */
+                        "cafe\xcc\x81");            /* café, decomposed */
+    passed &= len_words(&wclist) == 5;
+    passed &= counted(&wclist, "\xc8\x99\xc8\x9b\xc4\x83", 2) &&
+              counted(&wclist, "\xc3\xa9t\xc3\xa9", 1) &&
+              counted(&wclist, "\xcf\x83\xce\xbf\xcf\x86\xce\xb9\xce\xb1", 1) &&
+              counted(&wclist, "\xd0\xbc\xd0\xb8\xd1\x80", 2) &&
+              counted(&wclist, "cafe\xcc\x81", 1);
+
+    printf("test_utf8_words: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* Word boundaries fall after ASCII non-letters only, so a cut never lands
+ * inside a word or a multibyte sequence. */
+void test_split_point() {
+    struct {
+        const char *text;
+        size_t split;
+    } cases[] = {
+        {"hello wor", 6},                /* mid-word */
+        {"ab cd ", 6},                   /* already at a boundary */
+        {"ab1cd", 3},                    /* digits end words too */
+        {"caf\xc3\xa9 cr\xc3", 6},       /* inside a two-byte sequence */
+        {"ab \xe2\x82", 3},              /* inside a three-byte sequence */
+        {"\xc3\xa9t\xc3\xa9", 0},        /* no separator, multibyte */
+        {"abcdef", 0},                   /* no separator */
+        {"", 0},
+    };
+    size_t n = sizeof(cases) / sizeof(cases[0]);
+    bool passed = true;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        passed &= word_split_point((const unsigned char *) cases[i].text,
+                                   strlen(cases[i].text)) == cases[i].split;
+    }
+    printf("test_split_point: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* Whether the last WORDS words of TEXT start at START, and FOUND of them
+ * were there. */
+static bool tail_is(const char *text, int words, size_t start, int found) {
+    int actual;
+    return word_tail_start((const unsigned char *) text, strlen(text), words,
+                           &actual) == start &&
+           actual == found;
+}
+
+void test_tail_start() {
+    bool passed = true;
 
-//     if (wc != NULL && strcmp(wc->word, "test") == 0) {
-//         printf("test_find_word: PASSED\n");
-//     } else {
-//         printf("test_find_word: FAILED\n");
-//     }
-// }
+    passed &= tail_is("the quick brown fox", 2, 10, 2);
+    passed &= tail_is("the quick brown fox.", 1, 16, 1);
+    passed &= tail_is("alpha b gamma a", 2, 0, 2); /* one-letter words */
+    passed &= tail_is("ab", 3, 0, 1);
+    passed &= tail_is(" , ", 2, 3, 0);
+    passed &= tail_is("", 1, 0, 0);
+    /* Non-ASCII bytes are letters only to the UTF-8 tokenizer, and then
+     * only in valid sequences. */
+    passed &= tail_is("caf\xc3\xa9 na\xc3\xafve", 1, 10, 1);
+    count_words_mode = TOKENIZE_UTF8;
+    passed &= tail_is("caf\xc3\xa9 na\xc3\xafve", 1, 6, 1);
+    passed &= tail_is("caf\xc3\xa9 na\xc3\xafve", 2, 0, 2);
+    passed &= tail_is("ab\xed\xa0\x80" "cd", 1, 5, 1);   /* surrogate */
+    passed &= tail_is("ab\xed\xa0\x80" "cd", 2, 0, 2);
+    count_words_mode = TOKENIZE_ASCII;
 
-// void test_add_word() {
-//     word_count_list_t wclist;
-//     init_words(&wclist);
+    printf("test_tail_start: %s\n", passed ? "PASSED" : "FAILED");
+}
+
+/* Counts TEXT[0, LEN) into WCLIST. */
+static void count_text(word_count_list_t *wclist, const char *text,
+                       size_t len) {
+    FILE *infile;
+    if (len == 0) {
+        return;
+    }
+    infile = fmemopen((void *) text, len, "r");
+    count_words(wclist, infile);
+    fclose(infile);
+}
 
-//     add_word(&wclist, strdup("example"));
-//     word_count_t *wc = find_word(&wclist, "example");
+/*
+ * Whether counting TEXT in two chunks, cut at word_split_point and with the
+ * second led by the last N-1 words of the first, as pwords does for stdin,
+ * gives the same N-grams as counting it whole, wherever the cut falls.
+ */
+static bool chunks_match(const char *text, int n) {
+    size_t len = strlen(text), cut;
+    word_count_list_t whole;
+    bool passed = true;
 
-//     if (wc != NULL && strcmp(wc->word, "example") == 0 && wc->count == 1) {
-//         printf("test_add_word: PASSED\n");
-//     } else {
-//         printf("test_add_word: FAILED\n");
-//     }
-// }
+    count_words_ngram = n;
+    init_words(&whole);
+    count_text(&whole, text, len);
+    for (cut = 1; cut < len; cut++) {
+        size_t split = word_split_point((const unsigned char *) text, cut);
+        word_count_list_t chunked;
+        size_t start;
+        int found;
+
+        if (split == 0) {
+            continue;
+        }
+        /* The context and the rest of the text are contiguous here. */
+        start = word_tail_start((const unsigned char *) text, split, n - 1,
+                                &found);
+        init_words(&chunked);
+        count_text(&chunked, text, split);
+        count_text(&chunked, text + start, len - start);
+
+        passed &= len_words(&chunked) == len_words(&whole);
+        for (struct list_elem *e = list_begin(&whole.lst);
+             e != list_end(&whole.lst); e = list_next(e)) {
+            const word_count_t *wc = list_entry(e, word_count_t, elem);
+            passed &= counted(&chunked, wc_word(wc), wc->count);
+        }
+    }
+    count_words_ngram = 1;
+    return passed;
+}
+
+/* Trigrams are the same whether or not the text is cut into chunks. */
+void test_ngram_chunks() {
+    bool passed = true;
+
+    passed &= chunks_match("the cat, a dog and the cat sat; the cat sat "
+                           "on a mat and the dog sat", 3);
+    count_words_mode = TOKENIZE_UTF8;
+    passed &= chunks_match("l'\xc3\xa9t\xc3\xa9 est l\xc3\xa0, "
+                           "\xc3\xa9t\xc3\xa9 est \xc3\xa9t\xc3\xa9", 3);
+    count_words_mode = TOKENIZE_ASCII;
+
+    printf("test_ngram_chunks: %s\n", passed ? "PASSED" : "FAILED");
+}
 
 int main() {
     test_init_words();
-   // test_len_words();
-   // test_find_word();
-   // test_add_word();
+    test_len_words();
+    test_find_word();
+    test_add_word();
+    test_inline_keys();
+    test_utf8_words();
+    test_split_point();
+    test_tail_start();
+    test_ngram_chunks();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,638 @@
+/*
+ * Implementation of the word_aio interface.
+ *
+ * Blocks cycle between a free list, a file's queue (in flight, then ready)
+ * and the consumer of that file. Queues are in file order, so a consumer
+ * only ever waits on the head of its own queue. To keep consumers from
+ * starving, read-ahead into files nobody has claimed yet may use only part of
+ * the blocks, and each file only its share.
+ */
+
+#include "word_aio.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "word_mem.h"
+#include "word_trace.h"
+
+/* Most files opened ahead of their claim, to stay well under fd limits. */
+#define AIO_OPEN_AHEAD 16
+
+enum block_state { BLOCK_FREE, BLOCK_INFLIGHT, BLOCK_READY };
+
+struct aio_block {
+    unsigned char *data;
+    size_t want;  /* Bytes requested. */
+    size_t len;   /* Bytes read so far. */
+    off_t offset; /* File offset of data[0]. */
+    int err;      /* errno of a failed read, or 0. */
+    enum block_state state;
+    struct aio_file *file;
+    struct aio_block *next;
+};
+
+struct aio_file {
+    struct word_source src; /* First, so sources convert back to files. */
+    struct word_aio *aio;
+    const char *path;
+    int fd;
+    bool opened;
+    bool failed;
+    bool claimed;
+    off_t size;
+    off_t next_offset;       /* Next offset to submit a read for. */
+    struct aio_block *head;  /* Submitted blocks, in file order. */
+    struct aio_block *tail;
+    struct aio_block *current; /* Block handed to the consumer. */
+    int queued;
+};
+
+/* Minimal io_uring: one submission and one completion ring. */
+struct uring {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned pending; /* SQEs written but not yet submitted. */
+};
+
+struct word_aio {
+    pthread_mutex_t lock;
+    pthread_cond_t ready; /* A block became ready, or a file ended. */
+    pthread_cond_t work;  /* A block was freed, a file claimed, or stop. */
+    pthread_t thread;
+    struct aio_file *files;
+    int nfiles;
+    int next_claim;       /* Files below this index are claimed. */
+    int first_active;     /* Files below this index are fully submitted. */
+    struct aio_block *blocks;
+    struct aio_block *free_blocks;
+    unsigned char *buffers;
+    int depth;
+    int inflight;
+    int unclaimed_blocks; /* Blocks queued for unclaimed files. */
+    int unclaimed_open;   /* Unclaimed files with an open descriptor. */
+    int prefetch_limit;   /* Cap on unclaimed_blocks. */
+    int per_file_limit;
+    bool stop;
+    bool use_uring;
+    struct uring ring;
+};
+
+/* io_uring setup and teardown. */
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit,
+                              unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ * Whether the ring FD supports IORING_OP_READ. Kernels 5.1 to 5.5 set up
+ * rings but fail every such read with EINVAL; they predate the probe too,
+ * so a failed probe means no.
+ */
+static bool uring_supports_read(int fd) {
+    unsigned nops = IORING_OP_READ + 1;
+    struct io_uring_probe *probe =
+        calloc(1, sizeof(*probe) + nops * sizeof(struct io_uring_probe_op));
+    bool supported;
+
+    if (probe == NULL) {
+        return false;
+    }
+    supported = sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe,
+                                      nops) == 0 &&
+                probe->last_op >= IORING_OP_READ &&
+                (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+static bool uring_init(struct uring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if ((r->fd = sys_io_uring_setup(entries, &p)) < 0) {
+        return false;
+    }
+    if (!uring_supports_read(r->fd)) {
+        close(r->fd);
+        return false;
+    }
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) {
+            r->sq_ring_size = r->cq_ring_size;
+        }
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        close(r->fd);
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            munmap(r->sq_ring, r->sq_ring_size);
+            close(r->fd);
+            return false;
+        }
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        if (r->cq_ring != r->sq_ring) {
+            munmap(r->cq_ring, r->cq_ring_size);
+        }
+        munmap(r->sq_ring, r->sq_ring_size);
+        close(r->fd);
+        return false;
+    }
+    r->sq_head = (unsigned *) ((char *) r->sq_ring + p.sq_off.head);
+    r->sq_tail = (unsigned *) ((char *) r->sq_ring + p.sq_off.tail);
+    r->sq_mask = (unsigned *) ((char *) r->sq_ring + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) ((char *) r->sq_ring + p.sq_off.array);
+    r->cq_head = (unsigned *) ((char *) r->cq_ring + p.cq_off.head);
+    r->cq_tail = (unsigned *) ((char *) r->cq_ring + p.cq_off.tail);
+    r->cq_mask = (unsigned *) ((char *) r->cq_ring + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) ((char *) r->cq_ring + p.cq_off.cqes);
+    r->pending = 0;
+    return true;
+}
+
+static void uring_exit(struct uring *r) {
+    munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    munmap(r->sq_ring, r->sq_ring_size);
+    close(r->fd);
+}
+
+/* Queues a read of block B; uring_enter submits it. */
+static void uring_prep_read(struct uring *r, struct aio_block *b) {
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = b->file->fd;
+    sqe->addr = (uintptr_t) (b->data + b->len);
+    sqe->len = b->want - b->len;
+    sqe->off = b->offset + b->len;
+    sqe->user_data = (uintptr_t) b;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->pending++;
+}
+
+/* Submits pending reads and waits for at least WAIT completions. */
+static int uring_enter(struct uring *r, unsigned wait) {
+    int rv;
+    do {
+        rv = sys_io_uring_enter(r->fd, r->pending, wait,
+                                wait ? IORING_ENTER_GETEVENTS : 0);
+    } while (rv < 0 && errno == EINTR);
+    if (rv >= 0) {
+        r->pending -= rv;
+    }
+    return rv;
+}
+
+/* Blocks. Called with the lock held. */
+
+static void block_free(struct word_aio *aio, struct aio_block *b) {
+    b->state = BLOCK_FREE;
+    b->next = aio->free_blocks;
+    aio->free_blocks = b;
+    pthread_cond_signal(&aio->work);
+}
+
+/*
+ * Returns every ready block queued on F, which its consumer is done with, to
+ * the pool, wherever it is in the queue. Blocks still in flight stay until
+ * they complete. Once none are left, the I/O thread is done with F too, and
+ * its descriptor is closed.
+ */
+static void file_drop_ready(struct word_aio *aio, struct aio_file *f) {
+    struct aio_block **link = &f->head, *b;
+
+    f->tail = NULL;
+    while ((b = *link) != NULL) {
+        if (b->state == BLOCK_READY) {
+            *link = b->next;
+            f->queued--;
+            block_free(aio, b);
+        } else {
+            f->tail = b;
+            link = &b->next;
+        }
+    }
+    if (f->head == NULL && f->fd >= 0) {
+        close(f->fd);
+        f->fd = -1;
+    }
+}
+
+/*
+ * Records the result RES of a read into B (bytes, or -errno). Returns true if
+ * the block is complete, false if the rest must be read again.
+ */
+static bool block_complete(struct word_aio *aio, struct aio_block *b,
+                           ssize_t res) {
+    if (res < 0) {
+        b->err = -res;
+    } else if (res == 0) {
+        /* The file shrank; hand over what there is. */
+        b->want = b->len;
+    } else {
+        b->len += res;
+    }
+    if (b->err == 0 && b->len < b->want) {
+        return false;
+    }
+    aio->inflight--;
+    b->state = BLOCK_READY;
+    if (b->file->failed && b->file->claimed) {
+        /* Its consumer gave up on the file. */
+        file_drop_ready(aio, b->file);
+    }
+    pthread_cond_broadcast(&aio->ready);
+    return true;
+}
+
+/*
+ * Picks the next read to issue: the first file, in claim order, that has
+ * data left and room under its limits. Returns the file, or NULL. Sets
+ * *NEEDS_OPEN if the file must be opened first.
+ */
+static struct aio_file *next_request(struct word_aio *aio, bool *needs_open) {
+    int i;
+
+    if (aio->free_blocks == NULL) {
+        return NULL;
+    }
+    while (aio->first_active < aio->nfiles) {
+        struct aio_file *f = &aio->files[aio->first_active];
+        if (!f->opened || (!f->failed && f->next_offset < f->size)) {
+            break;
+        }
+        aio->first_active++;
+    }
+    for (i = aio->first_active; i < aio->nfiles; i++) {
+        struct aio_file *f = &aio->files[i];
+        bool unclaimed = i >= aio->next_claim;
+        if (unclaimed && aio->unclaimed_blocks >= aio->prefetch_limit) {
+            return NULL;
+        }
+        if (!f->opened) {
+            if (unclaimed && aio->unclaimed_open >= AIO_OPEN_AHEAD) {
+                return NULL;
+            }
+            *needs_open = true;
+            return f;
+        }
+        if (!f->failed && f->next_offset < f->size &&
+            f->queued < aio->per_file_limit) {
+            *needs_open = false;
+            return f;
+        }
+    }
+    return NULL;
+}
+
+/* Takes a free block for the next read of F and queues it on F. */
+static struct aio_block *take_block(struct word_aio *aio, struct aio_file *f) {
+    struct aio_block *b = aio->free_blocks;
+    off_t left = f->size - f->next_offset;
+
+    aio->free_blocks = b->next;
+    b->file = f;
+    b->offset = f->next_offset;
+    b->want = left < AIO_BLOCK_SIZE ? (size_t) left : AIO_BLOCK_SIZE;
+    b->len = 0;
+    b->err = 0;
+    b->state = BLOCK_INFLIGHT;
+    b->next = NULL;
+    f->next_offset += b->want;
+    if (f->tail != NULL) {
+        f->tail->next = b;
+    } else {
+        f->head = b;
+    }
+    f->tail = b;
+    f->queued++;
+    if (!f->claimed) {
+        aio->unclaimed_blocks++;
+    }
+    aio->inflight++;
+    return b;
+}
+
+/* Opens F outside the lock. Called and returns with the lock held. */
+static void open_file(struct word_aio *aio, struct aio_file *f) {
+    struct stat st;
+    int fd, err = 0;
+    uint64_t start;
+
+    pthread_mutex_unlock(&aio->lock);
+    start = word_trace_begin();
+    if ((fd = open(f->path, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+        err = errno;
+    } else {
+        word_mem_advise_input(fd);
+    }
+    word_trace_end("open", start);
+    pthread_mutex_lock(&aio->lock);
+    f->opened = true;
+    if (err != 0) {
+        fprintf(stderr, "open: %s: %s\n", f->path, strerror(err));
+        if (fd >= 0) {
+            close(fd);
+        }
+        f->failed = true;
+    } else {
+        f->fd = fd;
+        f->size = st.st_size;
+        if (!f->claimed) {
+            aio->unclaimed_open++;
+        }
+    }
+    pthread_cond_broadcast(&aio->ready);
+}
+
+/* I/O thread using io_uring. */
+static void run_uring(struct word_aio *aio) {
+    struct uring *r = &aio->ring;
+
+    pthread_mutex_lock(&aio->lock);
+    while (!aio->stop) {
+        struct aio_file *f;
+        bool needs_open;
+        unsigned head, tail;
+
+        while ((f = next_request(aio, &needs_open)) != NULL) {
+            if (needs_open) {
+                open_file(aio, f);
+            } else {
+                uring_prep_read(r, take_block(aio, f));
+            }
+        }
+        if (aio->inflight == 0) {
+            pthread_cond_wait(&aio->work, &aio->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&aio->lock);
+        if (uring_enter(r, 1) < 0) {
+            perror("io_uring_enter");
+            exit(1);
+        }
+        pthread_mutex_lock(&aio->lock);
+
+        head = *r->cq_head;
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            struct aio_block *b = (struct aio_block *) (uintptr_t) cqe->user_data;
+            if (!block_complete(aio, b, cqe->res)) {
+                uring_prep_read(r, b);
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&aio->lock);
+}
+
+/* I/O thread falling back to one blocking pread() at a time. */
+static void run_pread(struct word_aio *aio) {
+    pthread_mutex_lock(&aio->lock);
+    while (!aio->stop) {
+        struct aio_file *f;
+        struct aio_block *b;
+        bool needs_open;
+        ssize_t res;
+
+        if ((f = next_request(aio, &needs_open)) == NULL) {
+            pthread_cond_wait(&aio->work, &aio->lock);
+            continue;
+        }
+        if (needs_open) {
+            open_file(aio, f);
+            continue;
+        }
+        b = take_block(aio, f);
+        do {
+            pthread_mutex_unlock(&aio->lock);
+            res = pread(f->fd, b->data + b->len, b->want - b->len,
+                        b->offset + b->len);
+            if (res < 0) {
+                res = -errno;
+            }
+            pthread_mutex_lock(&aio->lock);
+        } while (res == -EINTR || !block_complete(aio, b, res));
+    }
+    pthread_mutex_unlock(&aio->lock);
+}
+
+static void *io_thread(void *arg) {
+    struct word_aio *aio = arg;
+
+    word_trace_thread("aio");
+    if (aio->use_uring) {
+        run_uring(aio);
+    } else {
+        run_pread(aio);
+    }
+    return NULL;
+}
+
+/* Consumer side. */
+
+static bool aio_source_next(struct word_source *src, const unsigned char **buf,
+                            size_t *len) {
+    struct aio_file *f = (struct aio_file *) src;
+    struct word_aio *aio = f->aio;
+    struct aio_block *b;
+
+    pthread_mutex_lock(&aio->lock);
+    if (f->current != NULL) {
+        block_free(aio, f->current);
+        f->current = NULL;
+    }
+    for (;;) {
+        b = f->head;
+        if (f->failed || (b != NULL && b->state == BLOCK_READY) ||
+            (b == NULL && f->opened && f->next_offset >= f->size)) {
+            break;
+        }
+        pthread_cond_wait(&aio->ready, &aio->lock);
+    }
+    if (b != NULL && !f->failed && b->err != 0) {
+        fprintf(stderr, "read: %s: %s\n", f->path, strerror(b->err));
+        f->failed = true;
+    }
+    if (f->failed || b == NULL) {
+        /* End of the file: return what is already read to the pool. */
+        file_drop_ready(aio, f);
+        pthread_cond_signal(&aio->work);
+        pthread_mutex_unlock(&aio->lock);
+        return false;
+    }
+    f->head = b->next;
+    if (f->head == NULL) {
+        f->tail = NULL;
+    }
+    f->queued--;
+    f->current = b;
+    pthread_mutex_unlock(&aio->lock);
+
+    *buf = b->data;
+    *len = b->len;
+    return true;
+}
+
+struct word_aio *word_aio_start(char *const paths[], int npaths, int workers) {
+    struct word_aio *aio = calloc(1, sizeof(*aio));
+    int i;
+
+    if (aio == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    if (workers < 1) {
+        workers = 1;
+    }
+    aio->depth = AIO_DEPTH > 3 * workers ? AIO_DEPTH : 3 * workers;
+    aio->prefetch_limit = aio->depth - 2 * workers;
+    aio->per_file_limit = aio->depth / (2 * workers);
+    if (aio->per_file_limit < 2) {
+        aio->per_file_limit = 2;
+    }
+    aio->nfiles = npaths;
+    aio->files = calloc(npaths, sizeof(struct aio_file));
+    aio->blocks = calloc(aio->depth, sizeof(struct aio_block));
+    aio->buffers = word_mem_alloc((size_t) aio->depth * AIO_BLOCK_SIZE);
+    if (aio->files == NULL || aio->blocks == NULL || aio->buffers == NULL) {
+        perror("malloc");
+        free(aio->files);
+        free(aio->blocks);
+        word_mem_free(aio->buffers, (size_t) aio->depth * AIO_BLOCK_SIZE);
+        free(aio);
+        return NULL;
+    }
+    word_mem_account(MEM_IO, (long long) aio->depth * AIO_BLOCK_SIZE);
+    for (i = 0; i < npaths; i++) {
+        aio->files[i].src.next = aio_source_next;
+        aio->files[i].aio = aio;
+        aio->files[i].path = paths[i];
+        aio->files[i].fd = -1;
+    }
+    for (i = 0; i < aio->depth; i++) {
+        aio->blocks[i].data = aio->buffers + (size_t) i * AIO_BLOCK_SIZE;
+        aio->blocks[i].next = aio->free_blocks;
+        aio->free_blocks = &aio->blocks[i];
+    }
+    pthread_mutex_init(&aio->lock, NULL);
+    pthread_cond_init(&aio->ready, NULL);
+    pthread_cond_init(&aio->work, NULL);
+    aio->use_uring = uring_init(&aio->ring, aio->depth);
+
+    if (pthread_create(&aio->thread, NULL, io_thread, aio) != 0) {
+        perror("pthread_create");
+        if (aio->use_uring) {
+            uring_exit(&aio->ring);
+        }
+        free(aio->files);
+        free(aio->blocks);
+        word_mem_free(aio->buffers, (size_t) aio->depth * AIO_BLOCK_SIZE);
+        word_mem_account(MEM_IO, -(long long) aio->depth * AIO_BLOCK_SIZE);
+        free(aio);
+        return NULL;
+    }
+    return aio;
+}
+
+int word_aio_claim(struct word_aio *aio) {
+    struct aio_file *f;
+    int file = -1;
+
+    pthread_mutex_lock(&aio->lock);
+    if (aio->next_claim < aio->nfiles) {
+        file = aio->next_claim++;
+        f = &aio->files[file];
+        f->claimed = true;
+        aio->unclaimed_blocks -= f->queued;
+        if (f->opened && !f->failed) {
+            aio->unclaimed_open--;
+        }
+        pthread_cond_signal(&aio->work);
+    }
+    pthread_mutex_unlock(&aio->lock);
+    return file;
+}
+
+struct word_source *word_aio_source(struct word_aio *aio, int file) {
+    return &aio->files[file].src;
+}
+
+bool word_aio_uses_uring(struct word_aio *aio) {
+    return aio->use_uring;
+}
+
+void word_aio_finish(struct word_aio *aio) {
+    int i;
+
+    pthread_mutex_lock(&aio->lock);
+    aio->stop = true;
+    pthread_cond_signal(&aio->work);
+    pthread_mutex_unlock(&aio->lock);
+    pthread_join(aio->thread, NULL);
+
+    if (aio->use_uring) {
+        uring_exit(&aio->ring);
+    }
+    for (i = 0; i < aio->nfiles; i++) {
+        if (aio->files[i].fd >= 0) {
+            close(aio->files[i].fd);
+        }
+    }
+    pthread_mutex_destroy(&aio->lock);
+    pthread_cond_destroy(&aio->ready);
+    pthread_cond_destroy(&aio->work);
+    free(aio->files);
+    free(aio->blocks);
+    word_mem_free(aio->buffers, (size_t) aio->depth * AIO_BLOCK_SIZE);
+    word_mem_account(MEM_IO, -(long long) aio->depth * AIO_BLOCK_SIZE);
+    free(aio);
+}
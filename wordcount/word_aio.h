@@ -0,0 +1,47 @@
+/*
+ * The word_aio interface reads many input files asynchronously for
+ * count_words_source.
+ *
+ * A dedicated I/O thread keeps up to a fixed number of block reads in flight
+ * across files, using io_uring when the kernel allows it and blocking pread()
+ * otherwise. Worker threads claim files one at a time and consume each
+ * file's blocks in order through a word_source, so tokenizing overlaps with
+ * reads of the files that come next.
+ */
+
+#ifndef WORD_AIO_H
+#define WORD_AIO_H
+
+#include <stdbool.h>
+
+#include "word_helpers.h"
+
+/* Size of one read, and default number of blocks in flight or buffered. */
+#define AIO_BLOCK_SIZE (128 * 1024)
+#define AIO_DEPTH 64
+
+struct word_aio;
+
+/*
+ * Starts reading the NPATHS files in PATHS for up to WORKERS consumers.
+ * Returns NULL on failure.
+ */
+struct word_aio *word_aio_start(char *const paths[], int npaths, int workers);
+
+/* Claims the next unread file. Returns its index in PATHS, or -1 if none. */
+int word_aio_claim(struct word_aio *aio);
+
+/*
+ * Returns the source of the blocks of claimed file FILE. Only the claiming
+ * thread may use it. A file that cannot be read is reported on stderr and
+ * yields no blocks.
+ */
+struct word_source *word_aio_source(struct word_aio *aio, int file);
+
+/* Returns true if reads go through io_uring rather than pread(). */
+bool word_aio_uses_uring(struct word_aio *aio);
+
+/* Stops the I/O thread and frees AIO. All claimed files must be finished. */
+void word_aio_finish(struct word_aio *aio);
+
+#endif /* WORD_AIO_H */
@@ -0,0 +1,226 @@
+/*
+ * Implementation of the word_count interface on top of the word_backend
+ * registry.
+ */
+
+#ifndef WORD_REGISTRY
+#error "WORD_REGISTRY must be #define'd when compiling word_backend.c"
+#endif
+
+#include "word_backend.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "word_hash.h"
+#include "word_stats.h"
+
+extern const struct word_backend wb_list_backend;
+extern const struct word_backend wb_pintos_backend;
+extern const struct word_backend wb_locked_backend;
+extern const struct word_backend wb_compact_backend;
+extern const struct word_backend wb_art_backend;
+
+static const struct word_backend *const backends[] = {
+    &wb_list_backend,    &wb_pintos_backend, &wb_locked_backend,
+    &wb_compact_backend, &wb_art_backend,
+};
+
+#define NUM_BACKENDS (sizeof(backends) / sizeof(backends[0]))
+
+const struct word_backend *word_backend = &wb_list_backend;
+
+static void print_backends(FILE *outfile) {
+    size_t i;
+    for (i = 0; i < NUM_BACKENDS; i++) {
+        fprintf(outfile, "  %-8s %s\n", backends[i]->name,
+                backends[i]->description);
+    }
+}
+
+bool word_backend_select(const char *prog, const char *name,
+                         const char *fallback) {
+    size_t i;
+
+    if (name == NULL) {
+        name = fallback;
+    }
+    if (strcmp(name, "help") == 0) {
+        printf("backends:\n");
+        print_backends(stdout);
+        exit(0);
+    }
+    for (i = 0; i < NUM_BACKENDS; i++) {
+        if (strcmp(name, backends[i]->name) == 0) {
+            word_backend = backends[i];
+            if (word_stats_enabled) {
+                fprintf(stderr, "%s: %s backend\n", prog, name);
+            }
+            return true;
+        }
+    }
+    fprintf(stderr, "%s: no backend named %s; there are:\n", prog, name);
+    print_backends(stderr);
+    return false;
+}
+
+bool word_backend_has_prefix(word_count_list_t *wclist) {
+    return wclist->backend->prefix != NULL;
+}
+
+/*
+ * What the lookups return for a word that is there, in place of its entry,
+ * which the caller could not read safely once the lock is released.
+ */
+static const word_count_t found;
+
+static inline const word_count_t *found_or_null(const word_count_t *wc) {
+    return wc == NULL ? NULL : &found;
+}
+
+/* Takes WCLIST's lock if its backend does not lock for itself. */
+static inline void enter(word_count_list_t *wclist) {
+    if (!wclist->backend->thread_safe) {
+        word_mutex_lock(&wclist->lock);
+    }
+}
+
+static inline void leave(word_count_list_t *wclist) {
+    if (!wclist->backend->thread_safe) {
+        word_mutex_unlock(&wclist->lock);
+    }
+}
+
+void init_words(word_count_list_t *wclist) {
+    wclist->backend = word_backend;
+    if ((wclist->impl = malloc(word_backend->list_size)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    pthread_mutex_init(&wclist->lock, NULL);
+    word_backend->init(wclist->impl);
+}
+
+size_t len_words(word_count_list_t *wclist) {
+    size_t len;
+    enter(wclist);
+    len = wclist->backend->len(wclist->impl);
+    leave(wclist);
+    return len;
+}
+
+const word_count_t *find_word(word_count_list_t *wclist, char *word) {
+    const word_count_t *wc;
+    enter(wclist);
+    wc = wclist->backend->find(wclist->impl, word);
+    leave(wclist);
+    return found_or_null(wc);
+}
+
+int word_backend_count(word_count_list_t *wclist, char *word) {
+    const word_count_t *wc;
+    int count;
+    /* A backend that locks for itself never moves or frees an entry, so
+     * its count is still there to read once find has let go. */
+    enter(wclist);
+    wc = wclist->backend->find(wclist->impl, word);
+    count = wc == NULL ? 0 : wc->count;
+    leave(wclist);
+    return count;
+}
+
+const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                   const word_token_t *tok, int count) {
+    const word_count_t *wc;
+    enter(wclist);
+    wc = wclist->backend->find_or_insert(wclist->impl, tok, count);
+    leave(wclist);
+    return found_or_null(wc);
+}
+
+const word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
+                                        int count) {
+    size_t len = strlen(word);
+    word_token_t tok = {word, len, word_hash(word, len)};
+    const word_count_t *wc = find_or_insert(wclist, &tok, count);
+    free(word);
+    return wc;
+}
+
+const word_count_t *add_word(word_count_list_t *wclist, char *word) {
+    return add_word_with_count(wclist, word, 1);
+}
+
+const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                    uint64_t hash) {
+    word_token_t tok = {word, strlen(word), hash};
+    const word_count_t *wc = find_or_insert(wclist, &tok, 1);
+    free(word);
+    return wc;
+}
+
+size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                       size_t n) {
+    size_t added;
+    enter(wclist);
+    added = wclist->backend->add_batch(wclist->impl, tokens, n);
+    leave(wclist);
+    return added;
+}
+
+size_t bytes_words(word_count_list_t *wclist) {
+    size_t bytes;
+    enter(wclist);
+    bytes = sizeof(*wclist) + wclist->backend->bytes(wclist->impl);
+    leave(wclist);
+    return bytes;
+}
+
+void fprint_words(word_count_list_t *wclist, FILE *outfile) {
+    enter(wclist);
+    wclist->backend->fprint(wclist->impl, outfile);
+    leave(wclist);
+}
+
+void wordcount_sort(word_count_list_t *wclist,
+                    bool less(const word_count_t *, const word_count_t *)) {
+    enter(wclist);
+    wclist->backend->sort(wclist->impl, less);
+    leave(wclist);
+}
+
+void foreach_words(word_count_list_t *wclist,
+                   void fn(const word_count_t *, void *), void *aux) {
+    enter(wclist);
+    wclist->backend->foreach(wclist->impl, fn, aux);
+    leave(wclist);
+}
+
+void prefix_words(word_count_list_t *wclist, const char *prefix,
+                  void fn(const word_count_t *, void *), void *aux) {
+    enter(wclist);
+    wclist->backend->prefix(wclist->impl, prefix, fn, aux);
+    leave(wclist);
+}
+
+/* foreach_words callback adding an entry of another list to the list AUX. */
+static void merge_entry(const word_count_t *wc, void *aux) {
+    word_count_list_t *dst = aux;
+    const char *word = wc_word(wc);
+    word_token_t tok = {word, wc->len, word_hash(word, wc->len)};
+    dst->backend->find_or_insert(dst->impl, &tok, wc->count);
+}
+
+void merge_words(word_count_list_t *dst, word_count_list_t *src,
+                 bool disjoint) {
+    enter(dst);
+    enter(src);
+    if (src->backend == dst->backend && dst->backend->merge != NULL) {
+        dst->backend->merge(dst->impl, src->impl, disjoint);
+    } else {
+        /* SRC's entries are only read, and stay until exit. */
+        src->backend->foreach(src->impl, merge_entry, dst);
+    }
+    leave(src);
+    leave(dst);
+}
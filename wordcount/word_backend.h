@@ -0,0 +1,130 @@
+/*
+ * The word_backend interface picks the word count backend at run time
+ * (--backend=NAME) rather than at compile time, so that words, pwords and
+ * fwords can each be run, and benchmarked, on every backend.
+ *
+ * Each backend is compiled a second time with -DWORD_BACKEND=NAME, which
+ * renames its word_count functions (see word_count.h), and registers them in
+ * a table with WORD_BACKEND_REGISTER. Frontends compiled with -DWORD_REGISTRY
+ * get a word_count_list_t that is a handle on a list of the chosen backend,
+ * and word_backend.c implements the word_count interface on the handle by
+ * calling through the table. The tokenizers hand lists their words in
+ * batches, through add_words_batch, so the indirect call, and the lock that
+ * serializes backends that do not lock for themselves, are paid once a batch
+ * rather than once a word.
+ */
+
+#ifndef WORD_BACKEND_H
+#define WORD_BACKEND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "word_count.h"
+
+struct word_backend {
+    const char *name;
+    const char *description;
+    size_t list_size; /* The backend's sizeof(word_count_list_t). */
+    bool thread_safe; /* Locks its lists itself. */
+    void (*init)(void *wclist);
+    size_t (*len)(void *wclist);
+    const word_count_t *(*find)(void *wclist, char *word);
+    const word_count_t *(*find_or_insert)(void *wclist,
+                                          const word_token_t *tok, int count);
+    size_t (*add_batch)(void *wclist, const word_token_t tokens[], size_t n);
+    size_t (*bytes)(void *wclist);
+    void (*fprint)(void *wclist, FILE *outfile);
+    void (*sort)(void *wclist,
+                 bool less(const word_count_t *, const word_count_t *));
+    void (*foreach)(void *wclist, void fn(const word_count_t *, void *),
+                    void *aux);
+    /* NULL unless the backend keeps its words in order. */
+    void (*prefix)(void *wclist, const char *prefix,
+                   void fn(const word_count_t *, void *), void *aux);
+    /* NULL if merge_words has to add SRC to DST word by word. */
+    void (*merge)(void *dst, void *src, bool disjoint);
+};
+
+/* The backend new lists are made with; set by word_backend_select. */
+extern const struct word_backend *word_backend;
+
+/*
+ * Makes NAME, or FALLBACK if NAME is NULL, the backend of lists made from now
+ * on. "help" prints the registered backends and exits. Returns false after
+ * printing an error that names PROG if there is no such backend.
+ */
+bool word_backend_select(const char *prog, const char *name,
+                         const char *fallback);
+
+/* Whether WCLIST's backend supports prefix_words. */
+bool word_backend_has_prefix(word_count_list_t *wclist);
+
+/* The count of WORD in WCLIST, read under its lock, or 0 if it is not there. */
+int word_backend_count(word_count_list_t *wclist, char *word);
+
+#ifdef WORD_BACKEND
+#define WORD_BACKEND_STRING2(name) #name
+#define WORD_BACKEND_STRING(name) WORD_BACKEND_STRING2(name)
+
+/*
+ * Registers the backend being compiled as wb_NAME_backend, described by
+ * DESCRIPTION. PREFIX and MERGE are the optional operations, taking void
+ * pointers, or NULL. Expands to thunks that take the table's void pointers.
+ */
+#define WORD_BACKEND_REGISTER(description, thread_safe, prefix, merge)        \
+    static void wb_init(void *wclist) {                                        \
+        init_words(wclist);                                                    \
+    }                                                                          \
+    static size_t wb_len(void *wclist) {                                       \
+        return len_words(wclist);                                              \
+    }                                                                          \
+    static const word_count_t *wb_find(void *wclist, char *word) {             \
+        return find_word(wclist, word);                                        \
+    }                                                                          \
+    static const word_count_t *wb_find_or_insert(void *wclist,                 \
+                                                 const word_token_t *tok,      \
+                                                 int count) {                  \
+        return find_or_insert(wclist, tok, count);                             \
+    }                                                                          \
+    static size_t wb_add_batch(void *wclist, const word_token_t tokens[],      \
+                               size_t n) {                                     \
+        return add_words_batch(wclist, tokens, n);                             \
+    }                                                                          \
+    static size_t wb_bytes(void *wclist) {                                     \
+        return bytes_words(wclist);                                            \
+    }                                                                          \
+    static void wb_fprint(void *wclist, FILE *outfile) {                       \
+        fprint_words(wclist, outfile);                                         \
+    }                                                                          \
+    static void wb_sort(void *wclist,                                          \
+                        bool less(const word_count_t *,                        \
+                                  const word_count_t *)) {                     \
+        wordcount_sort(wclist, less);                                          \
+    }                                                                          \
+    static void wb_foreach(void *wclist,                                       \
+                           void fn(const word_count_t *, void *),              \
+                           void *aux) {                                        \
+        foreach_words(wclist, fn, aux);                                        \
+    }                                                                          \
+    const struct word_backend WORD_BACKEND_SYMBOL(WORD_BACKEND, backend) = {  \
+        WORD_BACKEND_STRING(WORD_BACKEND),                                     \
+        description,                                                           \
+        sizeof(word_count_list_t),                                             \
+        thread_safe,                                                           \
+        wb_init,                                                               \
+        wb_len,                                                                \
+        wb_find,                                                               \
+        wb_find_or_insert,                                                     \
+        wb_add_batch,                                                          \
+        wb_bytes,                                                              \
+        wb_fprint,                                                             \
+        wb_sort,                                                               \
+        wb_foreach,                                                            \
+        prefix,                                                                \
+        merge,                                                                 \
+    }
+#endif /* WORD_BACKEND */
+
+#endif /* WORD_BACKEND_H */
@@ -0,0 +1,269 @@
+/*
+ * Microbenchmark of the word_count interface. Like the frontends it is built
+ * once per backend: bench_words, bench_lwords, bench_cwords, bench_awords and
+ * bench_pwords.
+ *
+ * Each key set is a vocabulary of distinct lowercase words and a stream of
+ * operations drawn from it:
+ *
+ *   uniform  every word equally likely
+ *   zipf     the i-th word with probability proportional to 1 / i^S
+ *   unique   every word once, so every add_word inserts
+ *   long     uniform, over words of 64 to 255 bytes that are not inline keys
+ *
+ * A trial counts the stream into an empty list with add_word, looks the
+ * stream up again with find_word, then sorts the list by count and prints it
+ * to /dev/null. Each operation is reported in ns/op as the mean, standard
+ * deviation and minimum over the trials; sorting and printing are per entry.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "word_count.h"
+#include "word_helpers.h"
+#include "word_keys.h"
+#include "word_stats.h"
+
+#if defined(COMPACT_TABLE)
+#define BACKEND "cwords"
+#elif defined(ART_TREE)
+#define BACKEND "awords"
+#elif defined(PTHREADS)
+#define BACKEND "pwords"
+#elif defined(PINTOS_LIST)
+#define BACKEND "lwords"
+#else
+#define BACKEND "words"
+#endif
+
+enum bench_op { OP_ADD, OP_FIND, OP_SORT, OP_PRINT, NUM_OPS };
+
+static const char *const op_names[NUM_OPS] = {
+    "add_word", "find_word", "wordcount_sort", "fprint_words"};
+
+enum key_set { KEYS_UNIFORM, KEYS_ZIPF, KEYS_UNIQUE, KEYS_LONG, NUM_KEY_SETS };
+
+static const char *const key_set_names[NUM_KEY_SETS] = {"uniform", "zipf",
+                                                        "unique", "long"};
+
+/* Settings, from the command line. */
+static size_t vocab = 1000;   /* -k: distinct words in a key set */
+static size_t ops = 10000;    /* -o: operations in a stream */
+static int trials = 5;        /* -t */
+static double zipf_s = 1.0;   /* -z */
+static uint64_t seed = 1;     /* -s */
+
+struct key_stream {
+    char **words;  /* The vocabulary. */
+    size_t nwords;
+    char **stream; /* Words of the operations, pointing into words. */
+    size_t n;
+};
+
+static void make_stream(enum key_set set, struct word_rng *rng,
+                        struct key_stream *ks) {
+    struct word_zipf *zipf = NULL;
+    size_t i;
+
+    ks->nwords = set == KEYS_UNIQUE ? ops : vocab;
+    ks->n = ops;
+    if ((ks->stream = malloc(ks->n * sizeof(char *))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if (set == KEYS_LONG) {
+        ks->words = word_keys_make(rng, ks->nwords, 64, 255);
+    } else {
+        ks->words = word_keys_make(rng, ks->nwords, 3, 12);
+    }
+    if (set == KEYS_ZIPF) {
+        zipf = word_zipf_new(ks->nwords, zipf_s);
+    }
+    for (i = 0; i < ks->n; i++) {
+        if (set == KEYS_UNIQUE) {
+            ks->stream[i] = ks->words[i];
+        } else if (set == KEYS_ZIPF) {
+            ks->stream[i] = ks->words[word_zipf_draw(zipf, rng)];
+        } else {
+            ks->stream[i] = ks->words[word_rng_below(rng, ks->nwords)];
+        }
+    }
+    word_zipf_free(zipf);
+
+    if (set == KEYS_UNIQUE) {
+        /* Insert in no particular order. */
+        for (i = ks->n - 1; i > 0; i--) {
+            size_t j = word_rng_below(rng, i + 1);
+            char *tmp = ks->stream[i];
+            ks->stream[i] = ks->stream[j];
+            ks->stream[j] = tmp;
+        }
+    }
+}
+
+static void free_stream(struct key_stream *ks) {
+    word_keys_free(ks->words, ks->nwords);
+    free(ks->stream);
+}
+
+/*
+ * Runs one trial over KS, storing ns per operation in NS. Returns the number
+ * of entries the list ended up with, or 0 if any lookup failed.
+ */
+static size_t run_trial(const struct key_stream *ks, FILE *devnull,
+                        double ns[NUM_OPS]) {
+    word_count_list_t wclist;
+    char **copies;
+    size_t i, found = 0, entries;
+    uint64_t start;
+
+    /* add_word takes ownership of its word, so copy them all up front. */
+    if ((copies = malloc(ks->n * sizeof(char *))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < ks->n; i++) {
+        if ((copies[i] = strdup(ks->stream[i])) == NULL) {
+            perror("strdup");
+            exit(1);
+        }
+    }
+    init_words(&wclist);
+
+    start = word_now_ns();
+    for (i = 0; i < ks->n; i++) {
+        add_word(&wclist, copies[i]);
+    }
+    ns[OP_ADD] = (double) (word_now_ns() - start) / ks->n;
+    free(copies);
+
+    start = word_now_ns();
+    for (i = 0; i < ks->n; i++) {
+        found += find_word(&wclist, ks->stream[i]) != NULL;
+    }
+    ns[OP_FIND] = (double) (word_now_ns() - start) / ks->n;
+
+    entries = len_words(&wclist);
+    start = word_now_ns();
+    wordcount_sort(&wclist, less_count);
+    ns[OP_SORT] = (double) (word_now_ns() - start) / entries;
+
+    start = word_now_ns();
+    fprint_words(&wclist, devnull);
+    fflush(devnull);
+    ns[OP_PRINT] = (double) (word_now_ns() - start) / entries;
+
+    /* The word_count interface cannot free a list; each trial leaks one. */
+    return found == ks->n ? entries : 0;
+}
+
+/* Benchmarks key set SET, printing a line per operation. */
+static bool bench_key_set(enum key_set set, FILE *devnull) {
+    struct word_rng rng;
+    struct key_stream ks;
+    double ns[trials][NUM_OPS];
+    size_t entries = 0;
+    int op, t;
+
+    /* Every key set is the same whatever others were chosen. */
+    word_rng_seed(&rng, seed + set);
+    make_stream(set, &rng, &ks);
+    for (t = 0; t < trials; t++) {
+        if ((entries = run_trial(&ks, devnull, ns[t])) == 0) {
+            fprintf(stderr, "%s: find_word missed words of key set %s\n",
+                    BACKEND, key_set_names[set]);
+            free_stream(&ks);
+            return false;
+        }
+    }
+    for (op = 0; op < NUM_OPS; op++) {
+        double sum = 0, sq = 0, min = ns[0][op];
+        for (t = 0; t < trials; t++) {
+            sum += ns[t][op];
+            sq += ns[t][op] * ns[t][op];
+            if (ns[t][op] < min) {
+                min = ns[t][op];
+            }
+        }
+        double mean = sum / trials;
+        double var = trials > 1 ? (sq - sum * mean) / (trials - 1) : 0;
+        printf("%-8s %-8s %8zu %9zu  %-15s %10.1f %9.1f %9.1f\n", BACKEND,
+               key_set_names[set], entries, ks.n, op_names[op], mean,
+               var > 0 ? sqrt(var) : 0, min);
+    }
+    fflush(stdout);
+    free_stream(&ks);
+    return true;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-k VOCAB] [-o OPS] [-t TRIALS] [-z S] [-s SEED] "
+            "[uniform|zipf|unique|long]...\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    bool chosen[NUM_KEY_SETS] = {false};
+    bool any = false, ok = true;
+    FILE *devnull;
+    int opt, i, set;
+
+    while ((opt = getopt(argc, argv, "k:o:t:z:s:")) != -1) {
+        switch (opt) {
+        case 'k':
+            vocab = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            ops = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            trials = atoi(optarg);
+            break;
+        case 'z':
+            zipf_s = atof(optarg);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (vocab == 0 || ops == 0 || trials <= 0 || zipf_s <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (i = optind; i < argc; i++) {
+        for (set = 0; set < NUM_KEY_SETS; set++) {
+            if (strcmp(argv[i], key_set_names[set]) == 0) {
+                break;
+            }
+        }
+        if (set == NUM_KEY_SETS) {
+            usage(argv[0]);
+            return 1;
+        }
+        chosen[set] = any = true;
+    }
+    if ((devnull = fopen("/dev/null", "w")) == NULL) {
+        perror("fopen");
+        return 1;
+    }
+
+    printf("%-8s %-8s %8s %9s  %-15s %10s %9s %9s\n", "backend", "keys",
+           "entries", "ops", "operation", "ns/op", "stddev", "min");
+    for (set = 0; set < NUM_KEY_SETS; set++) {
+        if (!any || chosen[set]) {
+            ok &= bench_key_set(set, devnull);
+        }
+    }
+    fclose(devnull);
+    return ok ? 0 : 1;
+}
@@ -23,62 +23,125 @@
 
 #include "word_count.h"
 
+#include <malloc.h>
+
+#include "word_mem.h"
+#include "word_stats.h"
+
+#ifdef WORD_BACKEND
+#include "word_backend.h"
+#endif
+
 void init_words(word_count_list_t *wclist) {
     /* Initialize word count.  */
-    *wclist = NULL;
+    wclist->head = NULL;
+    wclist->len = 0;
 }
 
 size_t len_words(word_count_list_t *wclist) {
-    size_t len = 0;
-    word_count_t *cur;
-    for (cur = *wclist; cur != NULL; cur = cur->next) {
-        len++;
-    }
-    return len;
+    return wclist->len;
 }
 
-word_count_t *find_word(word_count_list_t *wclist, char *word) {
+/* find_word for WORD of length LEN. */
+static word_count_t *find_len(word_count_list_t *wclist, const char *word,
+                              size_t len) {
     /* Return count for word, if it exists. */
-    word_count_t *wc = *wclist;
-    while ((wc != NULL) && (strcmp(word, wc->word) != 0)) {
+    word_count_t *wc = wclist->head;
+    size_t compares = 0;
+    word_key_t probe;
+    word_key_borrow(&probe, word, len);
+    while ((wc != NULL) &&
+           (compares++, !word_key_equal(&probe, len, &wc->key, wc->len))) {
         wc = wc->next;
     }
+    WORD_STATS_ADD(lookups, 1);
+    WORD_STATS_ADD(compares, compares);
     return wc;
 }
 
-word_count_t *add_word(word_count_list_t *wclist, char *word) {
+const word_count_t *find_word(word_count_list_t *wclist, char *word) {
+    return find_len(wclist, word, strlen(word));
+}
+
+const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                   const word_token_t *tok, int count) {
     /*
      * If word is present in word_counts list, increment the count.
-     * Otherwise, insert at head of list with count 1.
+     * Otherwise, insert a copy at head of list.
      */
-    word_count_t *wc = find_word(wclist, word);
+    word_count_t *wc = find_len(wclist, tok->word, tok->len);
     if (wc != NULL) {
-        wc->count++;
-    } else if ((wc = malloc(sizeof(word_count_t))) != NULL) {
-        wc->word = word;
-        wc->count = 1;
-        wc->next = *wclist;
-        *wclist = wc;
-    } else {
+        wc->count += count;
+        return wc;
+    }
+    if ((wc = malloc(sizeof(word_count_t))) == NULL ||
+        !word_key_copy(&wc->key, tok->word, tok->len)) {
         perror("malloc");
+        free(wc);
+        return NULL;
     }
+    word_mem_account(MEM_NODES, sizeof(word_count_t));
+    wc->len = tok->len;
+    wc->count = count;
+    wc->next = wclist->head;
+    wclist->head = wc;
+    wclist->len++;
+    WORD_STATS_ADD(inserts, 1);
+    WORD_STATS_ADD(allocs, 1 + (tok->len > WORD_INLINE_MAX));
+    return wc;
+}
+
+const word_count_t *add_word(word_count_list_t *wclist, char *word) {
+    word_token_t tok = {word, strlen(word), 0};
+    const word_count_t *wc = find_or_insert(wclist, &tok, 1);
+    free(word);
     return wc;
 }
 
+const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                    uint64_t hash) {
+    return add_word(wclist, word);
+}
+
+size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                       size_t n) {
+    size_t i, added = 0;
+    for (i = 0; i < n; i++) {
+        if (find_or_insert(wclist, &tokens[i], 1) != NULL) {
+            added++;
+        }
+    }
+    return added;
+}
+
+size_t bytes_words(word_count_list_t *wclist) {
+    /* Each malloc'd block also carries a size_t header. */
+    size_t bytes = sizeof(*wclist);
+    word_count_t *wc;
+    for (wc = wclist->head; wc != NULL; wc = wc->next) {
+        bytes += malloc_usable_size(wc) + sizeof(size_t);
+        if (wc->len > WORD_INLINE_MAX) {
+            bytes += malloc_usable_size(wc->key.ptr) + sizeof(size_t);
+        }
+    }
+    return bytes;
+}
+
 void fprint_words(word_count_list_t *wclist, FILE *outfile) {
     word_count_t *wc;
-    for (wc = *wclist; wc != NULL; wc = wc->next) {
-        fprintf(outfile, "%8d\t%s\n", wc->count, wc->word);
+    for (wc = wclist->head; wc != NULL; wc = wc->next) {
+        fprintf(outfile, "%8d\t%s\n", wc->count, wc_word(wc));
     }
 }
 
-void wordcount_insert_ordered(word_count_list_t *wclist, word_count_t *elem,
-                              bool less(const word_count_t *,
-                                        const word_count_t *)) {
-    word_count_t *prev = *wclist;
+/* Inserts ELEM into the list starting at *HEAD, sorted by LESS. */
+static void wordcount_insert_ordered(word_count_t **head, word_count_t *elem,
+                                     bool less(const word_count_t *,
+                                               const word_count_t *)) {
+    word_count_t *prev = *head;
     if (prev == NULL || less(elem, prev)) {
         elem->next = prev;
-        *wclist = elem;
+        *head = elem;
     } else {
         word_count_t *cur = prev->next;
         while (cur != NULL && less(cur, elem)) {
@@ -92,14 +155,26 @@ void wordcount_insert_ordered(word_count_list_t *wclist, word_count_t *elem,
 
 void wordcount_sort(word_count_list_t *wclist,
                     bool less(const word_count_t *, const word_count_t *)) {
-    word_count_t *head = *wclist;
-    word_count_list_t sorted;
-    init_words(&sorted);
+    word_count_t *head = wclist->head;
+    word_count_t *sorted = NULL;
     while (head != NULL) {
         word_count_t *to_insert = head;
         head = head->next;
         to_insert->next = NULL;
         wordcount_insert_ordered(&sorted, to_insert, less);
     }
-    *wclist = sorted;
+    wclist->head = sorted;
+}
+
+void foreach_words(word_count_list_t *wclist,
+                   void fn(const word_count_t *, void *), void *aux) {
+    word_count_t *wc;
+    for (wc = wclist->head; wc != NULL; wc = wc->next) {
+        fn(wc, aux);
+    }
 }
+
+#ifdef WORD_BACKEND
+WORD_BACKEND_REGISTER("singly linked list, newest word first", false, NULL,
+                      NULL);
+#endif
@@ -1,8 +1,8 @@
 /*
  * The word_count interface provides lists of words and associated counts.
  *
- * You may NOT modify this file. Any changes you make to this file will not
- * be used when grading your submission.
+ * Every backend implements the functions declared here; the representation
+ * each one uses is chosen with the macros described below.
  */
 
 /*
@@ -31,16 +31,88 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "word_key.h"
+
 /*
  * Representation of a word count object and word count list object.
- * PINTOS_LIST and/or PTHREADS are #define'd prior to #include to select the
- * representations.
+ * PINTOS_LIST and/or PTHREADS, COMPACT_TABLE or ART_TREE are #define'd prior
+ * to #include to select the representations. Every word_count_t begins with
+ * the same key, len and count members, so word_helpers.o can be shared by
+ * all of them. WORD_REGISTRY instead leaves the choice to run time; see
+ * word_backend.h.
+ */
+
+#if defined(WORD_REGISTRY)
+#include <pthread.h>
+
+/* Any backend's entry, seen through the members they all begin with. */
+typedef struct word_count {
+    word_key_t key;
+    uint32_t len;
+    int count;
+} word_count_t;
+
+/*
+ * A registry list holds its lock only for the length of each call, after
+ * which another thread may change or move the entry (a compact table reuses
+ * one view for every result). So on these lists find_word, find_or_insert
+ * and the add_word functions return NULL or a pointer that says the word is
+ * there but is not its entry and must only be compared with NULL; read a
+ * count with word_backend_count instead.
+ */
+typedef struct word_count_list {
+    const struct word_backend *backend;
+    void *impl;           /* The backend's own list. */
+    pthread_mutex_t lock; /* Serializes backends that do not lock. */
+} word_count_list_t;
+
+#elif defined(COMPACT_TABLE)
+
+/*
+ * A compact table keeps its entries as parallel arrays rather than nodes, so
+ * find_word and add_word return a read-only view of the entry, copied into
+ * the list and valid until the next call on it.
  */
+typedef struct word_count {
+    word_key_t key;
+    uint32_t len;
+    int count;
+} word_count_t;
+
+typedef struct word_count_list {
+    size_t len;        /* Number of entries. */
+    size_t cap;        /* Capacity of the entry arrays. */
+    int *counts;       /* counts[i] is the count of entry i. */
+    uint32_t *offsets; /* Offset of entry i's word in pool. */
+    uint32_t *hashes;  /* High bits of the mixed hash of entry i's word. */
+    uint32_t *slots;   /* Open-addressing index: entry + 1, or 0 if empty. */
+    size_t nslots;     /* Power of two. */
+    char *pool;        /* NUL-terminated words, back to back. */
+    size_t pool_len;
+    size_t pool_cap;
+    word_count_t view;
+} word_count_list_t;
+
+#elif defined(ART_TREE)
+
+/* Leaf of an adaptive radix tree; see word_count_art.c. */
+typedef struct word_count {
+    word_key_t key;
+    uint32_t len;
+    int count;
+} word_count_t;
+
+typedef struct word_count_list {
+    void *root;
+    size_t len;
+    word_count_t **order; /* Set by wordcount_sort unless lexical. */
+} word_count_list_t;
 
-#ifdef PINTOS_LIST
+#elif defined(PINTOS_LIST)
 #include "list.h"
 typedef struct word_count {
-    char *word;
+    word_key_t key;
+    uint32_t len;
     int count;
     struct list_elem elem;
 } word_count_t;
@@ -49,44 +121,128 @@ typedef struct word_count {
 #include <pthread.h>
 typedef struct word_count_list {
     struct list lst;
+    size_t len; /* Number of entries in lst. */
     pthread_mutex_t lock;
 } word_count_list_t;
 #else /* PTHREADS */
-typedef struct list word_count_list_t;
+typedef struct word_count_list {
+    struct list lst;
+    size_t len; /* Number of entries in lst. */
+} word_count_list_t;
 #endif /* PTHREADS */
 
 #else /* PINTOS_LIST */
 
 typedef struct word_count {
-    char *word;
+    word_key_t key;
+    uint32_t len;
     int count;
     struct word_count *next;
 } word_count_t;
 
-typedef word_count_t *word_count_list_t;
-#endif /* PINTOS_LIST */
+typedef struct word_count_list {
+    word_count_t *head;
+    size_t len; /* Number of entries from head on. */
+} word_count_list_t;
+#endif /* WORD_REGISTRY, COMPACT_TABLE, ART_TREE, PINTOS_LIST */
+
+/* Returns the word of a word count entry. */
+static inline const char *wc_word(const word_count_t *wc) {
+    return word_key_str(&wc->key, wc->len);
+}
+
+/*
+ * A word as the tokenizer produces it: NUL-terminated, LEN bytes long, with
+ * HASH = word_hash(word, len) computed along the way.
+ */
+typedef struct word_token {
+    const char *word;
+    size_t len;
+    uint64_t hash;
+} word_token_t;
+
+/* Compares the words of two entries in strcmp order. */
+static inline int wc_compare_words(const word_count_t *wc1,
+                                   const word_count_t *wc2) {
+    return word_key_compare(&wc1->key, wc1->len, &wc2->key, wc2->len);
+}
+
+/*
+ * A backend compiled for the registry (-DWORD_BACKEND=NAME) defines the
+ * functions below as wb_NAME_init_words and so on, so that every backend
+ * can be linked into the same binary.
+ */
+#ifdef WORD_BACKEND
+#define WORD_BACKEND_PASTE(name, fn) wb_##name##_##fn
+#define WORD_BACKEND_SYMBOL(name, fn) WORD_BACKEND_PASTE(name, fn)
+#define init_words WORD_BACKEND_SYMBOL(WORD_BACKEND, init_words)
+#define len_words WORD_BACKEND_SYMBOL(WORD_BACKEND, len_words)
+#define find_word WORD_BACKEND_SYMBOL(WORD_BACKEND, find_word)
+#define find_or_insert WORD_BACKEND_SYMBOL(WORD_BACKEND, find_or_insert)
+#define add_word WORD_BACKEND_SYMBOL(WORD_BACKEND, add_word)
+#define add_word_with_count \
+    WORD_BACKEND_SYMBOL(WORD_BACKEND, add_word_with_count)
+#define add_word_hashed WORD_BACKEND_SYMBOL(WORD_BACKEND, add_word_hashed)
+#define add_words_batch WORD_BACKEND_SYMBOL(WORD_BACKEND, add_words_batch)
+#define bytes_words WORD_BACKEND_SYMBOL(WORD_BACKEND, bytes_words)
+#define fprint_words WORD_BACKEND_SYMBOL(WORD_BACKEND, fprint_words)
+#define wordcount_sort WORD_BACKEND_SYMBOL(WORD_BACKEND, wordcount_sort)
+#define foreach_words WORD_BACKEND_SYMBOL(WORD_BACKEND, foreach_words)
+#define merge_words WORD_BACKEND_SYMBOL(WORD_BACKEND, merge_words)
+#define prefix_words WORD_BACKEND_SYMBOL(WORD_BACKEND, prefix_words)
+#endif /* WORD_BACKEND */
 
 /* Initialize a word count list. */
 void init_words(word_count_list_t *wclist);
 
-/* Get length of a word count list. */
+/* Get length of a word count list: its number of distinct words, in O(1). */
 size_t len_words(word_count_list_t *wclist);
 
 /* Find a word in a word_count list. */
-word_count_t *find_word(word_count_list_t *wclist, char *word);
+const word_count_t *find_word(word_count_list_t *wclist, char *word);
+
+/*
+ * Adds COUNT to the word of TOK, inserting it if not already present. The
+ * list only borrows TOK's word and copies it if it is new, so callers can
+ * tokenize into one reusable buffer. Returns the entry, or NULL if out of
+ * memory.
+ */
+const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                   const word_token_t *tok, int count);
 
 /*
  * Insert word with count=1, if not already present; increment count if
- * present. Takes ownership of word.
+ * present. Takes ownership of word, which is freed once counted.
  */
-word_count_t *add_word(word_count_list_t *wclist, char *word);
+const word_count_t *add_word(word_count_list_t *wclist, char *word);
 
 /*
  * Insert word with count, if not already present; increment count if present.
- * Takes ownership of word.
+ * Takes ownership of word, which is freed once counted.
+ */
+const word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
+                                        int count);
+
+/*
+ * Like add_word, with HASH = word_hash(word, strlen(word)) supplied by the
+ * caller. Hash-based lists use it instead of hashing word again; the others
+ * ignore it.
  */
-word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
-                                  int count);
+const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                    uint64_t hash);
+
+/*
+ * Adds each of the N tokens in TOKENS with count 1, borrowing their words as
+ * find_or_insert does. Lists use the tokens' lengths and hashes rather than
+ * scanning the words again; hash-based lists prefetch the slots of the whole
+ * batch before resolving any word, so lookups overlap their cache misses.
+ * Returns the number of words added; any others could not be stored.
+ */
+size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                       size_t n);
+
+/* Returns the bytes of memory held by a word count list. */
+size_t bytes_words(word_count_list_t *wclist);
 
 /* Print word counts to a file. */
 void fprint_words(word_count_list_t *wclist, FILE *outfile);
@@ -95,4 +251,28 @@ void fprint_words(word_count_list_t *wclist, FILE *outfile);
 void wordcount_sort(word_count_list_t *wclist,
                     bool less(const word_count_t *, const word_count_t *));
 
+/* Calls FN with AUX on every entry, in no particular order. */
+void foreach_words(word_count_list_t *wclist,
+                   void fn(const word_count_t *, void *), void *aux);
+
+#if defined(PINTOS_LIST) || defined(WORD_REGISTRY)
+/*
+ * Moves the entries of SRC into DST, adding up the counts of words in both.
+ * SRC must not be used afterwards. DISJOINT promises that no word is in
+ * both, which lets lists be spliced rather than merged word by word.
+ */
+void merge_words(word_count_list_t *dst, word_count_list_t *src,
+                 bool disjoint);
+#endif /* PINTOS_LIST || WORD_REGISTRY */
+
+#if defined(ART_TREE) || defined(WORD_REGISTRY)
+/*
+ * Calls FN with AUX on every entry whose word starts with PREFIX, in
+ * alphabetical order. Under WORD_REGISTRY only backends that keep their
+ * words in order support it; see word_backend_has_prefix.
+ */
+void prefix_words(word_count_list_t *wclist, const char *prefix,
+                  void fn(const word_count_t *, void *), void *aux);
+#endif /* ART_TREE || WORD_REGISTRY */
+
 #endif /* WORD_COUNT_H */
@@ -0,0 +1,753 @@
+/*
+ * Implementation of the word_count interface as an adaptive radix tree
+ * (Leis et al., "The Adaptive Radix Tree", ICDE 2013).
+ *
+ * Inner nodes branch on one byte of the word and grow through four sizes
+ * (4, 16, 48 and 256 children) as they fill, so the sparse fan-out typical of
+ * English words stays compact. Single-child paths are collapsed into a
+ * prefix stored in the node; only its first ART_MAX_PREFIX bytes are kept and
+ * longer prefixes are checked against a leaf. Keys include the terminating
+ * NUL, so no key is a prefix of another and an in-order walk visits words in
+ * strcmp order. Leaves are word_count_t entries, tagged in the low pointer
+ * bit.
+ */
+
+#define _GNU_SOURCE
+
+#ifndef ART_TREE
+#error "ART_TREE must be #define'd when compiling word_count_art.c"
+#endif
+
+#include "word_count.h"
+
+#include <malloc.h>
+
+#include "word_stats.h"
+
+#ifdef WORD_BACKEND
+#include "word_backend.h"
+#endif
+
+#define ART_MAX_PREFIX 10
+
+enum art_type { NODE4, NODE16, NODE48, NODE256 };
+
+struct art_node {
+    uint8_t type;
+    uint8_t num_children;
+    uint8_t prefix[ART_MAX_PREFIX];
+    uint32_t prefix_len;
+};
+
+struct art_node4 {
+    struct art_node n;
+    uint8_t keys[4];
+    void *children[4];
+};
+
+struct art_node16 {
+    struct art_node n;
+    uint8_t keys[16];
+    void *children[16];
+};
+
+/* index[b] is 1 + the slot of the child for byte b, or 0. */
+struct art_node48 {
+    struct art_node n;
+    uint8_t index[256];
+    void *children[48];
+};
+
+struct art_node256 {
+    struct art_node n;
+    void *children[256];
+};
+
+#define IS_LEAF(p) (((uintptr_t) (p)) & 1)
+#define SET_LEAF(l) ((void *) ((uintptr_t) (l) | 1))
+#define LEAF(p) ((word_count_t *) ((uintptr_t) (p) & ~(uintptr_t) 1))
+
+static inline size_t min_size(size_t a, size_t b) {
+    return a < b ? a : b;
+}
+
+/* Key bytes of a leaf, including the terminating NUL. */
+static inline const uint8_t *leaf_key(const word_count_t *l) {
+    return (const uint8_t *) wc_word(l);
+}
+
+static inline bool leaf_matches(const word_count_t *l, const uint8_t *key,
+                                size_t key_len) {
+    return l->len + 1 == key_len && memcmp(leaf_key(l), key, key_len) == 0;
+}
+
+static const size_t node_sizes[] = {
+    sizeof(struct art_node4), sizeof(struct art_node16),
+    sizeof(struct art_node48), sizeof(struct art_node256)};
+
+static void *alloc_node(enum art_type type) {
+    struct art_node *n = calloc(1, node_sizes[type]);
+    if (n == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    WORD_STATS_ADD(allocs, 1);
+    word_mem_account(MEM_NODES, node_sizes[type]);
+    n->type = type;
+    return n;
+}
+
+static void free_node(struct art_node *n) {
+    word_mem_account(MEM_NODES, -(long long) node_sizes[n->type]);
+    free(n);
+}
+
+/* Frees the sort order, which holds a pointer to every leaf. */
+static void drop_order(word_count_list_t *wclist) {
+    if (wclist->order != NULL) {
+        free(wclist->order);
+        wclist->order = NULL;
+        word_mem_account(MEM_BUCKETS,
+                         -(long long) (wclist->len * sizeof(word_count_t *)));
+    }
+}
+
+void init_words(word_count_list_t *wclist) {
+    wclist->root = NULL;
+    wclist->len = 0;
+    wclist->order = NULL;
+}
+
+size_t len_words(word_count_list_t *wclist) {
+    return wclist->len;
+}
+
+/* Returns the child slot of N for byte C, or NULL. */
+static void **find_child(struct art_node *n, uint8_t c) {
+    int i;
+    switch (n->type) {
+    case NODE4: {
+        struct art_node4 *p = (struct art_node4 *) n;
+        for (i = 0; i < n->num_children; i++) {
+            if (p->keys[i] == c) {
+                return &p->children[i];
+            }
+        }
+        break;
+    }
+    case NODE16: {
+        struct art_node16 *p = (struct art_node16 *) n;
+        for (i = 0; i < n->num_children && p->keys[i] <= c; i++) {
+            if (p->keys[i] == c) {
+                return &p->children[i];
+            }
+        }
+        break;
+    }
+    case NODE48: {
+        struct art_node48 *p = (struct art_node48 *) n;
+        if (p->index[c] != 0) {
+            return &p->children[p->index[c] - 1];
+        }
+        break;
+    }
+    case NODE256: {
+        struct art_node256 *p = (struct art_node256 *) n;
+        if (p->children[c] != NULL) {
+            return &p->children[c];
+        }
+        break;
+    }
+    }
+    return NULL;
+}
+
+/* Returns the leftmost leaf below N. */
+static word_count_t *minimum(void *n) {
+    int i;
+    while (!IS_LEAF(n)) {
+        struct art_node *node = n;
+        switch (node->type) {
+        case NODE4:
+            n = ((struct art_node4 *) node)->children[0];
+            break;
+        case NODE16:
+            n = ((struct art_node16 *) node)->children[0];
+            break;
+        case NODE48: {
+            struct art_node48 *p = n;
+            for (i = 0; p->index[i] == 0; i++) {
+            }
+            n = p->children[p->index[i] - 1];
+            break;
+        }
+        case NODE256: {
+            struct art_node256 *p = n;
+            for (i = 0; p->children[i] == NULL; i++) {
+            }
+            n = p->children[i];
+            break;
+        }
+        }
+    }
+    return LEAF(n);
+}
+
+/*
+ * Returns how many bytes of N's prefix match KEY at DEPTH, looking at no
+ * more than KEY_LEN - DEPTH bytes. Bytes past the stored part of the prefix
+ * are read from the leftmost leaf.
+ */
+static size_t prefix_mismatch(struct art_node *n, const uint8_t *key,
+                              size_t key_len, size_t depth) {
+    size_t max_cmp = min_size(min_size(ART_MAX_PREFIX, n->prefix_len),
+                              key_len - depth);
+    size_t idx;
+    for (idx = 0; idx < max_cmp; idx++) {
+        if (n->prefix[idx] != key[depth + idx]) {
+            return idx;
+        }
+    }
+    if (n->prefix_len > ART_MAX_PREFIX) {
+        const word_count_t *l = minimum(n);
+        const uint8_t *lkey = leaf_key(l);
+        max_cmp = min_size(min_size(n->prefix_len, l->len + 1 - depth),
+                           key_len - depth);
+        for (; idx < max_cmp; idx++) {
+            if (lkey[depth + idx] != key[depth + idx]) {
+                return idx;
+            }
+        }
+    }
+    return idx;
+}
+
+const word_count_t *find_word(word_count_list_t *wclist, char *word) {
+    const uint8_t *key = (const uint8_t *) word;
+    size_t key_len = strlen(word) + 1;
+    size_t depth = 0;
+    size_t visited = 0;
+    void *n = wclist->root;
+    word_count_t *result = NULL;
+
+    while (n != NULL) {
+        struct art_node *node = n;
+        void **child;
+        visited++;
+        if (IS_LEAF(n)) {
+            if (leaf_matches(LEAF(n), key, key_len)) {
+                result = LEAF(n);
+            }
+            break;
+        }
+        /* Only the stored prefix is checked; the leaf settles the rest. */
+        if (node->prefix_len != 0) {
+            size_t stored = min_size(node->prefix_len, ART_MAX_PREFIX);
+            if (depth + stored > key_len ||
+                memcmp(node->prefix, key + depth, stored) != 0) {
+                break;
+            }
+            depth += node->prefix_len;
+        }
+        if (depth >= key_len) {
+            break;
+        }
+        child = find_child(node, key[depth]);
+        n = child != NULL ? *child : NULL;
+        depth++;
+    }
+    WORD_STATS_ADD(lookups, 1);
+    WORD_STATS_ADD(compares, visited);
+    return result;
+}
+
+static void copy_header(struct art_node *dest, struct art_node *src) {
+    dest->num_children = src->num_children;
+    dest->prefix_len = src->prefix_len;
+    memcpy(dest->prefix, src->prefix, ART_MAX_PREFIX);
+}
+
+static bool add_child256(struct art_node256 *n, uint8_t c, void *child) {
+    n->n.num_children++; /* Wraps to 0 at 256 children; it is unused. */
+    n->children[c] = child;
+    return true;
+}
+
+static bool add_child48(struct art_node48 *n, void **ref, uint8_t c,
+                        void *child) {
+    if (n->n.num_children < 48) {
+        int pos = 0;
+        while (n->children[pos] != NULL) {
+            pos++;
+        }
+        n->children[pos] = child;
+        n->index[c] = pos + 1;
+        n->n.num_children++;
+        return true;
+    } else {
+        struct art_node256 *grown = alloc_node(NODE256);
+        int i;
+        if (grown == NULL) {
+            return false;
+        }
+        for (i = 0; i < 256; i++) {
+            if (n->index[i] != 0) {
+                grown->children[i] = n->children[n->index[i] - 1];
+            }
+        }
+        copy_header(&grown->n, &n->n);
+        *ref = grown;
+        free_node(&n->n);
+        return add_child256(grown, c, child);
+    }
+}
+
+static bool add_child16(struct art_node16 *n, void **ref, uint8_t c,
+                        void *child) {
+    if (n->n.num_children < 16) {
+        int idx = 0;
+        while (idx < n->n.num_children && n->keys[idx] < c) {
+            idx++;
+        }
+        memmove(n->keys + idx + 1, n->keys + idx, n->n.num_children - idx);
+        memmove(n->children + idx + 1, n->children + idx,
+                (n->n.num_children - idx) * sizeof(void *));
+        n->keys[idx] = c;
+        n->children[idx] = child;
+        n->n.num_children++;
+        return true;
+    } else {
+        struct art_node48 *grown = alloc_node(NODE48);
+        int i;
+        if (grown == NULL) {
+            return false;
+        }
+        memcpy(grown->children, n->children, 16 * sizeof(void *));
+        for (i = 0; i < 16; i++) {
+            grown->index[n->keys[i]] = i + 1;
+        }
+        copy_header(&grown->n, &n->n);
+        *ref = grown;
+        free_node(&n->n);
+        return add_child48(grown, ref, c, child);
+    }
+}
+
+static bool add_child4(struct art_node4 *n, void **ref, uint8_t c,
+                       void *child) {
+    if (n->n.num_children < 4) {
+        int idx = 0;
+        while (idx < n->n.num_children && n->keys[idx] < c) {
+            idx++;
+        }
+        memmove(n->keys + idx + 1, n->keys + idx, n->n.num_children - idx);
+        memmove(n->children + idx + 1, n->children + idx,
+                (n->n.num_children - idx) * sizeof(void *));
+        n->keys[idx] = c;
+        n->children[idx] = child;
+        n->n.num_children++;
+        return true;
+    } else {
+        struct art_node16 *grown = alloc_node(NODE16);
+        if (grown == NULL) {
+            return false;
+        }
+        memcpy(grown->children, n->children, 4 * sizeof(void *));
+        memcpy(grown->keys, n->keys, 4);
+        copy_header(&grown->n, &n->n);
+        *ref = grown;
+        free_node(&n->n);
+        return add_child16(grown, ref, c, child);
+    }
+}
+
+static bool add_child(struct art_node *n, void **ref, uint8_t c, void *child) {
+    switch (n->type) {
+    case NODE4:
+        return add_child4((struct art_node4 *) n, ref, c, child);
+    case NODE16:
+        return add_child16((struct art_node16 *) n, ref, c, child);
+    case NODE48:
+        return add_child48((struct art_node48 *) n, ref, c, child);
+    default:
+        return add_child256((struct art_node256 *) n, c, child);
+    }
+}
+
+/* Makes a leaf holding a copy of WORD of length LEN. */
+static word_count_t *make_leaf(const char *word, size_t len, int count) {
+    word_count_t *l = malloc(sizeof(word_count_t));
+    if (l == NULL || !word_key_copy(&l->key, word, len)) {
+        perror("malloc");
+        free(l);
+        return NULL;
+    }
+    WORD_STATS_ADD(allocs, 1 + (len > WORD_INLINE_MAX));
+    WORD_STATS_ADD(inserts, 1);
+    word_mem_account(MEM_NODES, sizeof(word_count_t));
+    l->len = len;
+    l->count = count;
+    return l;
+}
+
+/* Frees a leaf made by make_leaf that never made it into the tree. */
+static void free_leaf(word_count_t *l) {
+    word_key_free(&l->key, l->len);
+    free(l);
+    word_mem_account(MEM_NODES, -(long long) sizeof(word_count_t));
+}
+
+/*
+ * Inserts WORD below the subtree *REF, whose first DEPTH key bytes are
+ * already matched. Sets *CREATED if a new leaf was made. Returns the leaf for
+ * WORD, or NULL if out of memory.
+ */
+static word_count_t *insert(void **ref, const char *word, size_t key_len,
+                            size_t depth, int count, bool *created) {
+    const uint8_t *key = (const uint8_t *) word;
+    void *n = *ref;
+    struct art_node *node;
+    struct art_node4 *split;
+    word_count_t *l;
+    void **child;
+    uint8_t c; /* Branch byte of WORD. */
+
+    WORD_STATS_ADD(compares, 1);
+    if (n == NULL) {
+        if ((l = make_leaf(word, key_len - 1, count)) != NULL) {
+            *ref = SET_LEAF(l);
+            *created = true;
+        }
+        return l;
+    }
+
+    if (IS_LEAF(n)) {
+        word_count_t *existing = LEAF(n);
+        const uint8_t *ekey = leaf_key(existing);
+        size_t common = 0;
+        if (leaf_matches(existing, key, key_len)) {
+            existing->count += count;
+            return existing;
+        }
+        /* Split the leaf: a node4 holding both leaves below their common
+         * prefix. Keys are NUL-terminated, so they differ before either
+         * ends. */
+        while (ekey[depth + common] == key[depth + common]) {
+            common++;
+        }
+        if ((split = alloc_node(NODE4)) == NULL) {
+            return NULL;
+        }
+        split->n.prefix_len = common;
+        memcpy(split->n.prefix, key + depth, min_size(ART_MAX_PREFIX, common));
+        add_child4(split, ref, ekey[depth + common], n);
+        c = key[depth + common];
+        if ((l = make_leaf(word, key_len - 1, count)) == NULL) {
+            free_node(&split->n);
+            return NULL;
+        }
+        add_child4(split, ref, c, SET_LEAF(l));
+        *ref = split;
+        *created = true;
+        return l;
+    }
+
+    node = n;
+    if (node->prefix_len != 0) {
+        size_t diff = prefix_mismatch(node, key, key_len, depth);
+        if (diff < node->prefix_len) {
+            /* The word leaves the node's prefix after DIFF bytes: put a
+             * node4 above it holding the shared part. Both allocations come
+             * before NODE's prefix is cut, so failing leaves it intact. */
+            c = key[depth + diff];
+            if ((l = make_leaf(word, key_len - 1, count)) == NULL) {
+                return NULL;
+            }
+            if ((split = alloc_node(NODE4)) == NULL) {
+                free_leaf(l);
+                return NULL;
+            }
+            split->n.prefix_len = diff;
+            memcpy(split->n.prefix, node->prefix,
+                   min_size(ART_MAX_PREFIX, diff));
+            if (node->prefix_len <= ART_MAX_PREFIX) {
+                add_child4(split, ref, node->prefix[diff], node);
+                node->prefix_len -= diff + 1;
+                memmove(node->prefix, node->prefix + diff + 1,
+                        min_size(ART_MAX_PREFIX, node->prefix_len));
+            } else {
+                const uint8_t *lkey = leaf_key(minimum(node));
+                node->prefix_len -= diff + 1;
+                add_child4(split, ref, lkey[depth + diff], node);
+                memcpy(node->prefix, lkey + depth + diff + 1,
+                       min_size(ART_MAX_PREFIX, node->prefix_len));
+            }
+            add_child4(split, ref, c, SET_LEAF(l));
+            *ref = split;
+            *created = true;
+            return l;
+        }
+        depth += node->prefix_len;
+    }
+
+    if ((child = find_child(node, key[depth])) != NULL) {
+        return insert(child, word, key_len, depth + 1, count, created);
+    }
+    c = key[depth];
+    if ((l = make_leaf(word, key_len - 1, count)) == NULL) {
+        return NULL;
+    }
+    if (!add_child(node, ref, c, SET_LEAF(l))) {
+        free_leaf(l);
+        return NULL;
+    }
+    *created = true;
+    return l;
+}
+
+const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                   const word_token_t *tok, int count) {
+    bool created = false;
+    word_count_t *wc;
+
+    WORD_STATS_ADD(lookups, 1);
+    wc = insert(&wclist->root, tok->word, tok->len + 1, 0, count, &created);
+    if (created) {
+        /* A previous sort order no longer covers every entry. */
+        drop_order(wclist);
+        wclist->len++;
+    }
+    return wc;
+}
+
+const word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
+                                        int count) {
+    word_token_t tok = {word, strlen(word), 0};
+    const word_count_t *wc = find_or_insert(wclist, &tok, count);
+    free(word);
+    return wc;
+}
+
+const word_count_t *add_word(word_count_list_t *wclist, char *word) {
+    return add_word_with_count(wclist, word, 1);
+}
+
+const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                    uint64_t hash) {
+    return add_word(wclist, word);
+}
+
+size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                       size_t n) {
+    size_t i, added = 0;
+    for (i = 0; i < n; i++) {
+        if (find_or_insert(wclist, &tokens[i], 1) != NULL) {
+            added++;
+        }
+    }
+    return added;
+}
+
+/* Calls FN on every leaf below N in key order. */
+static void walk(void *n, void fn(const word_count_t *, void *), void *aux) {
+    struct art_node *node = n;
+    int i;
+
+    if (n == NULL) {
+        return;
+    }
+    if (IS_LEAF(n)) {
+        fn(LEAF(n), aux);
+        return;
+    }
+    switch (node->type) {
+    case NODE4:
+        for (i = 0; i < node->num_children; i++) {
+            walk(((struct art_node4 *) node)->children[i], fn, aux);
+        }
+        break;
+    case NODE16:
+        for (i = 0; i < node->num_children; i++) {
+            walk(((struct art_node16 *) node)->children[i], fn, aux);
+        }
+        break;
+    case NODE48: {
+        struct art_node48 *p = n;
+        for (i = 0; i < 256; i++) {
+            if (p->index[i] != 0) {
+                walk(p->children[p->index[i] - 1], fn, aux);
+            }
+        }
+        break;
+    }
+    case NODE256: {
+        struct art_node256 *p = n;
+        for (i = 0; i < 256; i++) {
+            walk(p->children[i], fn, aux);
+        }
+        break;
+    }
+    }
+}
+
+void prefix_words(word_count_list_t *wclist, const char *prefix,
+                  void fn(const word_count_t *, void *), void *aux) {
+    const uint8_t *key = (const uint8_t *) prefix;
+    size_t key_len = strlen(prefix);
+    size_t depth = 0;
+    void *n = wclist->root;
+
+    while (n != NULL) {
+        struct art_node *node = n;
+        void **child;
+        if (IS_LEAF(n)) {
+            if (strncmp(wc_word(LEAF(n)), prefix, key_len) == 0) {
+                fn(LEAF(n), aux);
+            }
+            return;
+        }
+        if (depth == key_len) {
+            break;
+        }
+        if (node->prefix_len != 0) {
+            size_t matched = prefix_mismatch(node, key, key_len, depth);
+            if (matched < min_size(node->prefix_len, key_len - depth)) {
+                return;
+            }
+            /* PREFIX ends inside this node's compressed path. */
+            if (depth + node->prefix_len >= key_len) {
+                break;
+            }
+            depth += node->prefix_len;
+        }
+        child = find_child(node, key[depth]);
+        n = child != NULL ? *child : NULL;
+        depth++;
+    }
+    walk(n, fn, aux);
+}
+
+static size_t node_bytes(void *n) {
+    struct art_node *node = n;
+    size_t bytes;
+    int i;
+
+    if (n == NULL) {
+        return 0;
+    }
+    if (IS_LEAF(n)) {
+        word_count_t *l = LEAF(n);
+        bytes = malloc_usable_size(l) + sizeof(size_t);
+        if (l->len > WORD_INLINE_MAX) {
+            bytes += malloc_usable_size(l->key.ptr) + sizeof(size_t);
+        }
+        return bytes;
+    }
+    bytes = malloc_usable_size(n) + sizeof(size_t);
+    switch (node->type) {
+    case NODE4:
+        for (i = 0; i < node->num_children; i++) {
+            bytes += node_bytes(((struct art_node4 *) node)->children[i]);
+        }
+        break;
+    case NODE16:
+        for (i = 0; i < node->num_children; i++) {
+            bytes += node_bytes(((struct art_node16 *) node)->children[i]);
+        }
+        break;
+    case NODE48:
+        for (i = 0; i < 48; i++) {
+            bytes += node_bytes(((struct art_node48 *) node)->children[i]);
+        }
+        break;
+    case NODE256:
+        for (i = 0; i < 256; i++) {
+            bytes += node_bytes(((struct art_node256 *) node)->children[i]);
+        }
+        break;
+    }
+    return bytes;
+}
+
+size_t bytes_words(word_count_list_t *wclist) {
+    size_t bytes = sizeof(*wclist) + node_bytes(wclist->root);
+    if (wclist->order != NULL) {
+        bytes += malloc_usable_size(wclist->order) + sizeof(size_t);
+    }
+    return bytes;
+}
+
+static void print_leaf(const word_count_t *wc, void *aux) {
+    fprintf(aux, "%8d\t%s\n", wc->count, wc_word(wc));
+}
+
+void fprint_words(word_count_list_t *wclist, FILE *outfile) {
+    size_t i;
+    if (wclist->order == NULL) {
+        walk(wclist->root, print_leaf, outfile);
+        return;
+    }
+    for (i = 0; i < wclist->len; i++) {
+        print_leaf(wclist->order[i], outfile);
+    }
+}
+
+static void collect_leaf(const word_count_t *wc, void *aux) {
+    word_count_t ***next = aux;
+    *(*next)++ = (word_count_t *) wc;
+}
+
+static int compare_leaves(const void *a, const void *b, void *aux) {
+    bool (*less)(const word_count_t *, const word_count_t *) = aux;
+    const word_count_t *wc1 = *(word_count_t *const *) a;
+    const word_count_t *wc2 = *(word_count_t *const *) b;
+    if (less(wc1, wc2)) {
+        return -1;
+    }
+    return less(wc2, wc1) ? 1 : 0;
+}
+
+void wordcount_sort(word_count_list_t *wclist,
+                    bool less(const word_count_t *, const word_count_t *)) {
+    word_count_t **order, **next;
+    size_t i;
+
+    drop_order(wclist);
+    if (wclist->len < 2) {
+        return;
+    }
+    if ((order = malloc(wclist->len * sizeof(word_count_t *))) == NULL) {
+        perror("malloc");
+        return;
+    }
+    WORD_STATS_ADD(allocs, 1);
+    next = order;
+    walk(wclist->root, collect_leaf, &next);
+
+    /* The tree is already in alphabetical order; only sort if LESS
+     * disagrees with it somewhere. */
+    for (i = 1; i < wclist->len && !less(order[i], order[i - 1]); i++) {
+    }
+    if (i == wclist->len) {
+        free(order);
+        return;
+    }
+    qsort_r(order, wclist->len, sizeof(word_count_t *), compare_leaves, less);
+    wclist->order = order;
+    word_mem_account(MEM_BUCKETS, wclist->len * sizeof(word_count_t *));
+}
+
+void foreach_words(word_count_list_t *wclist,
+                   void fn(const word_count_t *, void *), void *aux) {
+    walk(wclist->root, fn, aux);
+}
+
+#ifdef WORD_BACKEND
+static void backend_prefix(void *wclist, const char *prefix,
+                           void fn(const word_count_t *, void *), void *aux) {
+    prefix_words(wclist, prefix, fn, aux);
+}
+
+WORD_BACKEND_REGISTER("adaptive radix tree, in alphabetical order", false,
+                      backend_prefix, NULL);
+#endif
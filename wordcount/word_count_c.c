@@ -0,0 +1,385 @@
+/*
+ * Implementation of the word_count interface as a compact, struct-of-arrays
+ * hash table.
+ *
+ * Entry i is described by counts[i], offsets[i] (its word in a single string
+ * pool) and hashes[i]; an open-addressing index of 32-bit entry numbers maps
+ * words to entries. An entry costs about 12 bytes plus its index slots and
+ * the word itself, against a malloc'd node per word in the list backends,
+ * and printing or sorting walks the arrays in order.
+ */
+
+#define _GNU_SOURCE
+
+#ifndef COMPACT_TABLE
+#error "COMPACT_TABLE must be #define'd when compiling word_count_c.c"
+#endif
+
+#include "word_count.h"
+#include "word_hash.h"
+#include "word_mem.h"
+#include "word_stats.h"
+
+#ifdef WORD_BACKEND
+#include "word_backend.h"
+#endif
+
+#define INITIAL_CAP 64
+#define INITIAL_POOL 1024
+
+/* Words add_words_batch hashes and prefetches ahead of resolving them. */
+#define BATCH_GROUP 16
+/* How far ahead of the word being resolved its entry is prefetched. */
+#define PREFETCH_AHEAD 4
+
+void init_words(word_count_list_t *wclist) {
+    memset(wclist, 0, sizeof(*wclist));
+}
+
+size_t len_words(word_count_list_t *wclist) {
+    return wclist->len;
+}
+
+static void fill_view(word_count_list_t *wclist, word_count_t *view,
+                      uint32_t e) {
+    const char *word = wclist->pool + wclist->offsets[e];
+    view->len = strlen(word);
+    word_key_borrow(&view->key, word, view->len);
+    view->count = wclist->counts[e];
+}
+
+/* Fills the list's view with entry E. */
+static const word_count_t *view_entry(word_count_list_t *wclist, uint32_t e) {
+    fill_view(wclist, &wclist->view, e);
+    return &wclist->view;
+}
+
+/*
+ * Entries are indexed by the high 32 bits of the mixed hash of their word,
+ * which are also what hashes[] keeps, so the index can be rebuilt without
+ * rehashing any word.
+ */
+static inline uint32_t hash_tag(const char *word, size_t len) {
+    return word_hash_mix(word_hash(word, len)) >> 32;
+}
+
+/*
+ * Returns the slot for WORD: either the slot holding its entry, or the empty
+ * slot where it would be inserted.
+ */
+static uint32_t *find_slot(word_count_list_t *wclist, const char *word,
+                           uint32_t tag) {
+    size_t mask = wclist->nslots - 1;
+    size_t i = tag & mask;
+    size_t compares = 0;
+
+    WORD_STATS_ADD(lookups, 1);
+    while (wclist->slots[i] != 0) {
+        uint32_t e = wclist->slots[i] - 1;
+        compares++;
+        if (wclist->hashes[e] == tag &&
+            strcmp(wclist->pool + wclist->offsets[e], word) == 0) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    WORD_STATS_ADD(compares, compares);
+    return &wclist->slots[i];
+}
+
+const word_count_t *find_word(word_count_list_t *wclist, char *word) {
+    uint32_t *slot;
+    if (wclist->len == 0) {
+        return NULL;
+    }
+    slot = find_slot(wclist, word, hash_tag(word, strlen(word)));
+    return *slot == 0 ? NULL : view_entry(wclist, *slot - 1);
+}
+
+/* Rebuilds the index with NSLOTS slots from the entry hashes. */
+static bool rehash(word_count_list_t *wclist, size_t nslots) {
+    uint32_t *slots = word_mem_alloc(nslots * sizeof(uint32_t));
+    size_t e;
+
+    if (slots == NULL) {
+        return false;
+    }
+    WORD_STATS_ADD(allocs, 1);
+    word_mem_account(MEM_BUCKETS,
+                     (long long) (nslots - wclist->nslots) * sizeof(uint32_t));
+    word_mem_free(wclist->slots, wclist->nslots * sizeof(uint32_t));
+    wclist->slots = slots;
+    wclist->nslots = nslots;
+    for (e = 0; e < wclist->len; e++) {
+        size_t i = wclist->hashes[e] & (nslots - 1);
+        while (slots[i] != 0) {
+            i = (i + 1) & (nslots - 1);
+        }
+        slots[i] = e + 1;
+    }
+    return true;
+}
+
+/* Grows *ARRAY of KIND from OLD_CAP to CAP elements of SIZE bytes. */
+static bool grow_array(void **array, size_t old_cap, size_t cap, size_t size,
+                       enum word_mem_kind kind) {
+    void *grown = word_mem_realloc(*array, old_cap * size, cap * size);
+    if (grown == NULL) {
+        return false;
+    }
+    WORD_STATS_ADD(allocs, 1);
+    word_mem_account(kind, (long long) (cap - old_cap) * size);
+    *array = grown;
+    return true;
+}
+
+/* Makes room for one more entry whose word is LEN bytes long. */
+static bool reserve(word_count_list_t *wclist, size_t len) {
+    if (wclist->len == wclist->cap) {
+        size_t cap = wclist->cap ? 2 * wclist->cap : INITIAL_CAP;
+        if (!grow_array((void **) &wclist->counts, wclist->cap, cap,
+                        sizeof(int), MEM_NODES) ||
+            !grow_array((void **) &wclist->offsets, wclist->cap, cap,
+                        sizeof(uint32_t), MEM_NODES) ||
+            !grow_array((void **) &wclist->hashes, wclist->cap, cap,
+                        sizeof(uint32_t), MEM_NODES)) {
+            return false;
+        }
+        wclist->cap = cap;
+    }
+    if (wclist->pool_len + len + 1 > wclist->pool_cap) {
+        size_t cap = wclist->pool_cap ? wclist->pool_cap : INITIAL_POOL;
+        while (wclist->pool_len + len + 1 > cap) {
+            cap *= 2;
+        }
+        if (cap > UINT32_MAX) {
+            fprintf(stderr, "word pool exceeds 4 GiB\n");
+            return false;
+        }
+        if (!grow_array((void **) &wclist->pool, wclist->pool_cap, cap, 1,
+                        MEM_STRINGS)) {
+            return false;
+        }
+        wclist->pool_cap = cap;
+    }
+    /* Keep the index at most 3/4 full. */
+    if (4 * (wclist->len + 1) > 3 * wclist->nslots) {
+        return rehash(wclist, wclist->nslots ? 2 * wclist->nslots
+                                             : 2 * INITIAL_CAP);
+    }
+    return true;
+}
+
+/*
+ * Adds COUNT to WORD, of length LEN and hash tag TAG, copying WORD into the
+ * pool if it is new. Only a new word makes room, so repeated words cost just
+ * their lookup.
+ */
+static const word_count_t *add_tagged(word_count_list_t *wclist,
+                                      const char *word, size_t len,
+                                      uint32_t tag, int count) {
+    size_t nslots = wclist->nslots;
+    uint32_t *slot = NULL;
+    size_t e;
+
+    if (nslots != 0) {
+        slot = find_slot(wclist, word, tag);
+        if (*slot != 0) {
+            e = *slot - 1;
+            wclist->counts[e] += count;
+            return view_entry(wclist, e);
+        }
+    }
+    if (!reserve(wclist, len)) {
+        return NULL;
+    }
+    if (wclist->nslots != nslots) {
+        /* The index was rebuilt, and the empty slot moved with it. */
+        slot = find_slot(wclist, word, tag);
+    }
+    e = wclist->len++;
+    wclist->counts[e] = count;
+    wclist->offsets[e] = wclist->pool_len;
+    wclist->hashes[e] = tag;
+    memcpy(wclist->pool + wclist->pool_len, word, len + 1);
+    wclist->pool_len += len + 1;
+    *slot = e + 1;
+    WORD_STATS_ADD(inserts, 1);
+    return view_entry(wclist, e);
+}
+
+const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                   const word_token_t *tok, int count) {
+    return add_tagged(wclist, tok->word, tok->len,
+                      word_hash_mix(tok->hash) >> 32, count);
+}
+
+const word_count_t *add_word_with_count(word_count_list_t *wclist,
+                                        char *word, int count) {
+    size_t len = strlen(word);
+    const word_count_t *wc =
+        add_tagged(wclist, word, len, hash_tag(word, len), count);
+    free(word);
+    return wc;
+}
+
+const word_count_t *add_word(word_count_list_t *wclist, char *word) {
+    return add_word_with_count(wclist, word, 1);
+}
+
+const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                    uint64_t hash) {
+    const word_count_t *wc = add_tagged(wclist, word, strlen(word),
+                                        word_hash_mix(hash) >> 32, 1);
+    free(word);
+    return wc;
+}
+
+/*
+ * Takes the tags of a group of tokens and prefetches their index slots,
+ * then resolves them in order. Each word's slot is loaded by the time it is
+ * resolved, and PREFETCH_AHEAD words in advance the entry it points at is
+ * prefetched too, so the cache misses of up to BATCH_GROUP lookups overlap.
+ */
+size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                       size_t n) {
+    uint32_t tags[BATCH_GROUP];
+    size_t added = 0;
+    size_t base, m, i;
+
+    for (base = 0; base < n; base += m) {
+        m = n - base < BATCH_GROUP ? n - base : BATCH_GROUP;
+        for (i = 0; i < m; i++) {
+            tags[i] = word_hash_mix(tokens[base + i].hash) >> 32;
+            if (wclist->nslots != 0) {
+                __builtin_prefetch(
+                    &wclist->slots[tags[i] & (wclist->nslots - 1)]);
+            }
+        }
+        for (i = 0; i < m; i++) {
+            if (i + PREFETCH_AHEAD < m && wclist->nslots != 0) {
+                uint32_t t = tags[i + PREFETCH_AHEAD];
+                uint32_t e = wclist->slots[t & (wclist->nslots - 1)];
+                if (e != 0) {
+                    __builtin_prefetch(&wclist->hashes[e - 1]);
+                    __builtin_prefetch(&wclist->offsets[e - 1]);
+                }
+            }
+            const word_token_t *tok = &tokens[base + i];
+            if (add_tagged(wclist, tok->word, tok->len, tags[i], 1) != NULL) {
+                added++;
+            }
+        }
+    }
+    return added;
+}
+
+size_t bytes_words(word_count_list_t *wclist) {
+    return sizeof(*wclist) +
+           wclist->cap * (sizeof(int) + 2 * sizeof(uint32_t)) +
+           wclist->nslots * sizeof(uint32_t) + wclist->pool_cap;
+}
+
+void fprint_words(word_count_list_t *wclist, FILE *outfile) {
+    size_t e;
+    for (e = 0; e < wclist->len; e++) {
+        fprintf(outfile, "%8d\t%s\n", wclist->counts[e],
+                wclist->pool + wclist->offsets[e]);
+    }
+}
+
+struct sort_ctx {
+    const word_count_t *views; /* views[e] is filled from entry e. */
+    bool (*less)(const word_count_t *, const word_count_t *);
+};
+
+static int compare_entries(const void *a, const void *b, void *aux) {
+    struct sort_ctx *ctx = aux;
+    const word_count_t *wc1 = &ctx->views[*(const uint32_t *) a];
+    const word_count_t *wc2 = &ctx->views[*(const uint32_t *) b];
+    if (ctx->less(wc1, wc2)) {
+        return -1;
+    }
+    return ctx->less(wc2, wc1) ? 1 : 0;
+}
+
+void wordcount_sort(word_count_list_t *wclist,
+                    bool less(const word_count_t *, const word_count_t *)) {
+    struct sort_ctx ctx = {NULL, less};
+    size_t n = wclist->len;
+    uint32_t *order, *offsets, *hashes;
+    word_count_t *views;
+    int *counts;
+    size_t i;
+
+    if (n < 2) {
+        return;
+    }
+    order = malloc(n * sizeof(uint32_t));
+    views = malloc(n * sizeof(word_count_t));
+    counts = word_mem_realloc(NULL, 0, n * sizeof(int));
+    offsets = word_mem_realloc(NULL, 0, n * sizeof(uint32_t));
+    hashes = word_mem_realloc(NULL, 0, n * sizeof(uint32_t));
+    if (order == NULL || views == NULL || counts == NULL || offsets == NULL ||
+        hashes == NULL) {
+        if (order == NULL || views == NULL) {
+            perror("malloc");
+        }
+        free(order);
+        free(views);
+        word_mem_free(counts, n * sizeof(int));
+        word_mem_free(offsets, n * sizeof(uint32_t));
+        word_mem_free(hashes, n * sizeof(uint32_t));
+        return;
+    }
+    WORD_STATS_ADD(allocs, 5);
+    word_mem_account(MEM_BUCKETS,
+                     n * (sizeof(uint32_t) + sizeof(word_count_t)));
+    word_mem_account(MEM_NODES, n * (sizeof(int) + 2 * sizeof(uint32_t)));
+
+    /*
+     * Fill every entry's view once, sort entry numbers comparing the views,
+     * then lay the arrays out in that order.
+     */
+    for (i = 0; i < n; i++) {
+        order[i] = i;
+        fill_view(wclist, &views[i], i);
+    }
+    ctx.views = views;
+    qsort_r(order, n, sizeof(uint32_t), compare_entries, &ctx);
+    for (i = 0; i < n; i++) {
+        counts[i] = wclist->counts[order[i]];
+        offsets[i] = wclist->offsets[order[i]];
+        hashes[i] = wclist->hashes[order[i]];
+    }
+    free(order);
+    free(views);
+    word_mem_account(MEM_BUCKETS, -(long long) (n * (sizeof(uint32_t) +
+                                                     sizeof(word_count_t))));
+    word_mem_account(MEM_NODES, -(long long) (wclist->cap *
+                                              (sizeof(int) +
+                                               2 * sizeof(uint32_t))));
+    word_mem_free(wclist->counts, wclist->cap * sizeof(int));
+    word_mem_free(wclist->offsets, wclist->cap * sizeof(uint32_t));
+    word_mem_free(wclist->hashes, wclist->cap * sizeof(uint32_t));
+    wclist->counts = counts;
+    wclist->offsets = offsets;
+    wclist->hashes = hashes;
+    wclist->cap = n;
+    rehash(wclist, wclist->nslots);
+}
+
+void foreach_words(word_count_list_t *wclist,
+                   void fn(const word_count_t *, void *), void *aux) {
+    word_count_t view;
+    uint32_t e;
+    for (e = 0; e < wclist->len; e++) {
+        fill_view(wclist, &view, e);
+        fn(&view, aux);
+    }
+}
+
+#ifdef WORD_BACKEND
+WORD_BACKEND_REGISTER("open-addressing hash index over packed arrays", false,
+                      NULL, NULL);
+#endif
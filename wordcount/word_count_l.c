@@ -26,23 +26,25 @@
 
 #include "word_count.h"
 
+#include <malloc.h>
+
+#include "word_mem.h"
+#include "word_stats.h"
+
+#ifdef WORD_BACKEND
+#include "word_backend.h"
+#endif
+
 //test
 void init_words(word_count_list_t *wclist) {
     /* Initialize word count.  */
-    list_init(wclist);
+    list_init(&wclist->lst);
+    wclist->len = 0;
 }
 
-//count the number of words in the list
+//the count is kept up to date by find_or_insert
 size_t len_words(word_count_list_t *wclist) {
-    size_t len = 0;
-    struct list_elem *e;
-    
-    // Properly iterate through the Pintos list
-    for (e = list_begin(wclist); e != list_end(wclist); e = list_next(e)) {
-        len++;
-    }
-    
-    return len;
+    return wclist->len;
 }
 
 
@@ -53,49 +55,106 @@ size_t len_words(word_count_list_t *wclist) {
 */
 
 
-/* Find a word in a word_count list. */
-word_count_t *find_word(word_count_list_t *wclist, char *word) {
+/* Find a word of length LEN in a word_count list. */
+static word_count_t *find_len(word_count_list_t *wclist, const char *word,
+                              size_t len) {
     struct list_elem *e;
+    size_t compares = 0;
+    word_key_t probe;
+    word_key_borrow(&probe, word, len);
+    WORD_STATS_ADD(lookups, 1);
     // Properly iterate through the Pintos list
-    for (e = list_begin(wclist); e != list_end(wclist); e = list_next(e)) {
-        if (strcmp(word, list_entry(e, word_count_t, elem)->word) == 0) {
-            return list_entry(e, word_count_t, elem);
+    for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e)) {
+        word_count_t *wc = list_entry(e, word_count_t, elem);
+        compares++;
+        if (word_key_equal(&probe, len, &wc->key, wc->len)) {
+            WORD_STATS_ADD(compares, compares);
+            return wc;
         }
     }
+    WORD_STATS_ADD(compares, compares);
     return NULL;
 }
 
-/*
- * Insert word with count=1, if not already present; increment count if
- * present. Takes ownership of word.
- */
-word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
-                                  int count) {
+/* Find a word in a word_count list. */
+const word_count_t *find_word(word_count_list_t *wclist, char *word) {
+    return find_len(wclist, word, strlen(word));
+}
+
+const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                   const word_token_t *tok, int count) {
     //traverse list through list_elem                                
-    word_count_t *wc = find_word(wclist, word);
+    word_count_t *wc = find_len(wclist, tok->word, tok->len);
     
     if (wc != NULL) {
         wc->count += count; 
-    } else if((wc = malloc(sizeof(word_count_t))) != NULL ){
-        wc->word = word;
-        wc->count = count;
-        list_push_back(wclist, &wc->elem); 
-    } else {
+        return wc;
+    }
+    // only a new word is copied
+    if ((wc = malloc(sizeof(word_count_t))) == NULL ||
+        !word_key_copy(&wc->key, tok->word, tok->len)) {
         perror("malloc");
+        free(wc);
+        return NULL;
     }
+    word_mem_account(MEM_NODES, sizeof(word_count_t));
+    wc->len = tok->len;
+    wc->count = count;
+    list_push_back(&wclist->lst, &wc->elem);
+    wclist->len++;
+    WORD_STATS_ADD(inserts, 1);
+    WORD_STATS_ADD(allocs, 1 + (tok->len > WORD_INLINE_MAX));
     return wc;
 }
 
-word_count_t *add_word(word_count_list_t *wclist, char *word) {
+const word_count_t *add_word_with_count(word_count_list_t *wclist, char *word,
+                                        int count) {
+    word_token_t tok = {word, strlen(word), 0};
+    const word_count_t *wc = find_or_insert(wclist, &tok, count);
+    free(word);
+    return wc;
+}
+
+const word_count_t *add_word(word_count_list_t *wclist, char *word) {
     return add_word_with_count(wclist, word, 1);
 }
 
+const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                    uint64_t hash) {
+    return add_word(wclist, word);
+}
+
+size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                       size_t n) {
+    size_t i, added = 0;
+    for (i = 0; i < n; i++) {
+        if (find_or_insert(wclist, &tokens[i], 1) != NULL) {
+            added++;
+        }
+    }
+    return added;
+}
+
+size_t bytes_words(word_count_list_t *wclist) {
+    /* Each malloc'd block also carries a size_t header. */
+    size_t bytes = sizeof(*wclist);
+    struct list_elem *e;
+    for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e)) {
+        word_count_t *wc = list_entry(e, word_count_t, elem);
+        bytes += malloc_usable_size(wc) + sizeof(size_t);
+        if (wc->len > WORD_INLINE_MAX) {
+            bytes += malloc_usable_size(wc->key.ptr) + sizeof(size_t);
+        }
+    }
+    return bytes;
+}
+
 void fprint_words(word_count_list_t *wclist, FILE *outfile) {
     struct list_elem *e;
     // Properly iterate through the Pintos list
-    for (e = list_begin(wclist); e != list_end(wclist); e = list_next(e)) {
+    for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e)) {
         word_count_t *wc = list_entry(e, word_count_t, elem);
-        fprintf(outfile, "%8d\t%s\n", wc->count, wc->word);
+        fprintf(outfile, "%8d\t%s\n", wc->count, wc_word(wc));
     }
 }
 
@@ -112,5 +171,44 @@ static bool less_list(const struct list_elem *ewc1,
 
 void wordcount_sort(word_count_list_t *wclist,
                     bool less(const word_count_t *, const word_count_t *)) {
-    list_sort(wclist, less_list, less);
+    list_sort(&wclist->lst, less_list, less);
+}
+
+void foreach_words(word_count_list_t *wclist,
+                   void fn(const word_count_t *, void *), void *aux) {
+    struct list_elem *e;
+    for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e)) {
+        fn(list_entry(e, word_count_t, elem), aux);
+    }
 }
+
+void merge_words(word_count_list_t *dst, word_count_list_t *src,
+                 bool disjoint) {
+    // nothing to look up: move the whole list over
+    if (disjoint || list_empty(&dst->lst)) {
+        list_splice(list_end(&dst->lst), list_begin(&src->lst),
+                    list_end(&src->lst));
+        dst->len += src->len;
+        src->len = 0;
+        return;
+    }
+    while (!list_empty(&src->lst)) {
+        word_count_t *wc = list_entry(list_pop_front(&src->lst), word_count_t,
+                                      elem);
+        word_token_t tok = {word_key_str(&wc->key, wc->len), wc->len, 0};
+        find_or_insert(dst, &tok, wc->count);
+        word_key_free(&wc->key, wc->len);
+        free(wc);
+        word_mem_account(MEM_NODES, -(long long) sizeof(word_count_t));
+    }
+    src->len = 0;
+}
+
+#ifdef WORD_BACKEND
+static void backend_merge(void *dst, void *src, bool disjoint) {
+    merge_words(dst, src, disjoint);
+}
+
+WORD_BACKEND_REGISTER("Pintos doubly linked list, in order of first use",
+                      false, NULL, backend_merge);
+#endif
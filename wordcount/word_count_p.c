@@ -30,63 +30,136 @@
  
  #include "word_count.h"
  
+ #include <malloc.h>
+ 
+ #include "word_mem.h"
+ #include "word_stats.h"
+ 
+ #ifdef WORD_BACKEND
+ #include "word_backend.h"
+ #endif
+ 
  void init_words(word_count_list_t *wclist) {
      list_init(&(wclist->lst));
+     wclist->len = 0;
      pthread_mutex_init(&(wclist->lock), NULL);
  }
  
- size_t len_words(word_count_list_t *wclist) { 
-     struct list_elem *e;
-     size_t length = 0; 
-     for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e))
-         length++;
-     return length;
+ // len is only written under the lock, so a racing reader sees some recent count
+ size_t len_words(word_count_list_t *wclist) {
+     return __atomic_load_n(&wclist->len, __ATOMIC_RELAXED);
  }
  
- word_count_t *find_word(word_count_list_t *wclist, char *word) {
+ /* find_word for WORD of length LEN. */
+ static word_count_t *find_len(word_count_list_t *wclist, const char *word, size_t len) {
      struct list_elem *e;
-     e = list_begin(&wclist->lst);
      word_count_t *result = NULL;
+     size_t compares = 0;
+     word_key_t probe;
+     word_key_borrow(&probe, word, len);
      for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e)) {
          word_count_t *wc = list_entry(e, word_count_t, elem);
-         if (strcmp(wc->word, word) == 0) {
+         compares++;
+         if (word_key_equal(&probe, len, &wc->key, wc->len)) {
              result = wc;
              break;
          }
      }
+     WORD_STATS_ADD(lookups, 1);
+     WORD_STATS_ADD(compares, compares);
      return result;
  }
+
+ const word_count_t *find_word(word_count_list_t *wclist, char *word) {
+     return find_len(wclist, word, strlen(word));
+ }
  
- word_count_t *add_word_with_count(word_count_list_t *wclist, char *word, int count) {
-     pthread_mutex_lock(&(wclist->lock));
-     word_count_t *wc = find_word(wclist, word);
+ /* find_or_insert with the list's lock held. */
+ static word_count_t *add_locked(word_count_list_t *wclist,
+                                 const word_token_t *tok, int count) {
+     word_count_t *wc = find_len(wclist, tok->word, tok->len);
      if (wc != NULL) {
          wc->count += count;
-     // if not in the list add to the head of the list
-     } else if ((wc = malloc(sizeof(word_count_t))) != NULL) {
-         wc->word = word;
-         wc->count = count;
-         list_push_back(&(wclist->lst), &wc->elem);
+         return wc;
      }
-     else {
+     // if not in the list add a copy to the end of the list
+     if ((wc = malloc(sizeof(word_count_t))) == NULL ||
+         !word_key_copy(&wc->key, tok->word, tok->len)) {
          perror("malloc");
-         pthread_mutex_unlock(&(wclist->lock));
+         free(wc);
+         return NULL;
      }
-     pthread_mutex_unlock(&(wclist->lock));
+     word_mem_account(MEM_NODES, sizeof(word_count_t));
+     wc->len = tok->len;
+     wc->count = count;
+     list_push_back(&(wclist->lst), &wc->elem);
+     __atomic_store_n(&wclist->len, wclist->len + 1, __ATOMIC_RELAXED);
+     WORD_STATS_ADD(inserts, 1);
+     WORD_STATS_ADD(allocs, 1 + (tok->len > WORD_INLINE_MAX));
+     return wc;
+ }
+
+ const word_count_t *find_or_insert(word_count_list_t *wclist,
+                                    const word_token_t *tok, int count) {
+     word_mutex_lock(&(wclist->lock));
+     word_count_t *wc = add_locked(wclist, tok, count);
+     word_mutex_unlock(&(wclist->lock));
      return wc;
  }
  
- word_count_t *add_word(word_count_list_t *wclist, char *word) {
+ const word_count_t *add_word_with_count(word_count_list_t *wclist, char *word, int count) {
+     word_token_t tok = {word, strlen(word), 0};
+     const word_count_t *wc = find_or_insert(wclist, &tok, count);
+     free(word);
+     return wc;
+ }
+ 
+ const word_count_t *add_word(word_count_list_t *wclist, char *word) {
      return add_word_with_count(wclist, word, 1);
  }
  
+ const word_count_t *add_word_hashed(word_count_list_t *wclist, char *word,
+                                     uint64_t hash) {
+     return add_word(wclist, word);
+ }
+
+ // one lock round trip for the whole batch instead of one per word
+ size_t add_words_batch(word_count_list_t *wclist, const word_token_t tokens[],
+                        size_t n) {
+     size_t added = 0;
+     word_mutex_lock(&(wclist->lock));
+     for (size_t i = 0; i < n; i++) {
+         if (add_locked(wclist, &tokens[i], 1) != NULL) {
+             added++;
+         }
+     }
+     word_mutex_unlock(&(wclist->lock));
+     return added;
+ }
+ 
+ size_t bytes_words(word_count_list_t *wclist) {
+     /* Each malloc'd block also carries a size_t header. */
+     size_t bytes = sizeof(*wclist);
+     struct list_elem *e;
+     for (e = list_begin(&wclist->lst); e != list_end(&wclist->lst); e = list_next(e)) {
+         word_count_t *wc = list_entry(e, word_count_t, elem);
+         bytes += malloc_usable_size(wc) + sizeof(size_t);
+         if (wc->len > WORD_INLINE_MAX) {
+             bytes += malloc_usable_size(wc->key.ptr) + sizeof(size_t);
+         }
+     }
+     return bytes;
+ }
+ 
+ // locked, so a snapshot can print the list while workers add to it
  void fprint_words(word_count_list_t *wclist, FILE *outfile) {
      struct list_elem *e;
+     word_mutex_lock(&(wclist->lock));
      for (e = list_begin(&(wclist->lst)); e != list_end(&(wclist->lst)); e = list_next(e)) {
          word_count_t *wc = list_entry(e, word_count_t, elem);
-         fprintf(outfile, "%8d\t%s\n", wc->count, wc->word);
+         fprintf(outfile, "%8d\t%s\n", wc->count, wc_word(wc));
      }
-     
+     word_mutex_unlock(&(wclist->lock));
  }
  
  static bool less_list(const struct list_elem *ewc1,
@@ -103,4 +176,48 @@
                      bool less(const word_count_t *, const word_count_t *)) {
      /* TODO */
      list_sort(&wclist->lst, less_list, less);
- }
\ No newline at end of file
+ }
+ // locked, like fprint_words
+ void foreach_words(word_count_list_t *wclist,
+                    void fn(const word_count_t *, void *), void *aux) {
+     struct list_elem *e;
+     word_mutex_lock(&(wclist->lock));
+     for (e = list_begin(&(wclist->lst)); e != list_end(&(wclist->lst)); e = list_next(e)) {
+         fn(list_entry(e, word_count_t, elem), aux);
+     }
+     word_mutex_unlock(&(wclist->lock));
+ }
+
+ // dst's lock, then src's; nothing merges the other way round
+ void merge_words(word_count_list_t *dst, word_count_list_t *src,
+                  bool disjoint) {
+     word_mutex_lock(&(dst->lock));
+     word_mutex_lock(&(src->lock));
+     if (disjoint || list_empty(&(dst->lst))) {
+         list_splice(list_end(&(dst->lst)), list_begin(&(src->lst)),
+                     list_end(&(src->lst)));
+         __atomic_store_n(&dst->len, dst->len + src->len, __ATOMIC_RELAXED);
+     } else {
+         while (!list_empty(&(src->lst))) {
+             word_count_t *wc = list_entry(list_pop_front(&(src->lst)),
+                                           word_count_t, elem);
+             word_token_t tok = {word_key_str(&wc->key, wc->len), wc->len, 0};
+             add_locked(dst, &tok, wc->count);
+             word_key_free(&wc->key, wc->len);
+             free(wc);
+             word_mem_account(MEM_NODES, -(long long) sizeof(word_count_t));
+         }
+     }
+     __atomic_store_n(&src->len, 0, __ATOMIC_RELAXED);
+     word_mutex_unlock(&(src->lock));
+     word_mutex_unlock(&(dst->lock));
+ }
+
+ #ifdef WORD_BACKEND
+ static void backend_merge(void *dst, void *src, bool disjoint) {
+     merge_words(dst, src, disjoint);
+ }
+
+ WORD_BACKEND_REGISTER("Pintos list behind a mutex, in order of first use",
+                       true, NULL, backend_merge);
+ #endif
@@ -0,0 +1,283 @@
+/*
+ * Implementation of the word_engine interface.
+ */
+
+#include "word_engine.h"
+
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "word_io.h"
+#include "word_numa.h"
+#include "word_options.h"
+
+/*
+ * Cost model, measured on the five texts in gutenberg/ (1.2 MiB, 12266
+ * distinct words) and on eight copies of them in one file. To recalibrate,
+ * rerun
+ *
+ *   make bench BENCH_ARGS='-k 100000 -o 1000000 zipf uniform'
+ *
+ * and words --backend=compact --stats on the texts, and time pwords,
+ * pwords --pipeline and fwords against words on the texts and on five
+ * one-word files.
+ *
+ * All of it was measured on one CPU, so only the single-threaded costs are
+ * calibrated. How the parallel engines scale is assumed, not measured: that
+ * the work divides evenly over the CPUs (count_ns / c), that the table's
+ * share of the work is a floor threads cannot go below (LOOKUP_SHARE), and
+ * that the pipeline's overhead stays the same with its stages on CPUs of
+ * their own (PIPELINE_SLOWDOWN).
+ *
+ * make calibrate measures those: stress_pwords' speedup on the shared table
+ * at 1, 2, 4, ... threads, and words, pwords and pwords --pipeline on the
+ * texts. Its results so far, on one CPU with the compact table:
+ *
+ *   stress_pwords   0.26 Mwords/s; 0.99x at 2 threads, 0.97x at 4
+ *   words           65 ms
+ *   pwords          52 ms
+ *   pwords --pipeline=1,1,1  57 ms
+ *
+ * Once it has been run on a machine with more CPUs, fit the terms above to
+ * its results and raise CALIBRATED_CPUS to that machine's count.
+ */
+
+/*
+ * The most CPUs the parallel terms have been calibrated on. With more, their
+ * estimates are printed but not trusted, and the single engine is chosen.
+ */
+#define CALIBRATED_CPUS 1
+
+/* Counting a byte with one thread on the compact table: 42-51 ns. */
+#define NS_PER_BYTE 45.0
+/*
+ * The share of it spent in the table: lookup / (tokenize + lookup), with one
+ * thread. Taking it as the part of the files engine that never runs in
+ * parallel is an assumption: it leaves out lock contention and cache line
+ * transfers, which would raise it, and the lock-free backends, which would
+ * lower it.
+ */
+#define LOOKUP_SHARE 0.44
+/* Starting and joining a thread: pwords over words, five one-word files. */
+#define THREAD_NS 130000.0
+/*
+ * Batches and rings: pwords --pipeline=1,1,1 over words, 9.4 MiB file, with
+ * all three stages taking turns on one CPU. That the handoffs cost as much
+ * between CPUs, where they move cache lines, is assumed.
+ */
+#define PIPELINE_SLOWDOWN 1.03
+/* Forking and reaping a child: fwords over words, five one-word files. */
+#define FORK_NS 300000.0
+/* Printing, piping, parsing and adding one entry of a child in fwords. */
+#define MERGE_NS_PER_WORD 850.0
+/*
+ * Distinct words in BYTES of text grow as BYTES^HEAPS_BETA (Heaps' law),
+ * from 2994 in alice.txt to HEAPS_WORDS in all of gutenberg/.
+ */
+#define HEAPS_WORDS 12266.0
+#define HEAPS_BYTES 1238370.0
+#define HEAPS_BETA 0.72
+/* Peak memory of the compact table per distinct word (--stats). */
+#define TABLE_BYTES_PER_WORD 48.0
+
+static const char *const engine_names[NUM_ENGINES] = {
+    [ENGINE_SINGLE] = "single",
+    [ENGINE_FILES] = "files",
+    [ENGINE_CHUNKS] = "chunks",
+    [ENGINE_PROCESSES] = "processes",
+};
+
+static const char *const engine_programs[NUM_ENGINES] = {
+    [ENGINE_SINGLE] = "words",
+    [ENGINE_FILES] = "pwords",
+    [ENGINE_CHUNKS] = "pwords",
+    [ENGINE_PROCESSES] = "fwords",
+};
+
+const char *word_engine_program(enum word_engine engine) {
+    return engine_programs[engine];
+}
+
+/* Returns MemAvailable, or free memory on kernels without it, or 0. */
+static uint64_t available_memory(void) {
+    unsigned long long kib;
+    char line[128];
+    long pages = sysconf(_SC_AVPHYS_PAGES), page = sysconf(_SC_PAGESIZE);
+    FILE *f;
+
+    if ((f = fopen("/proc/meminfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "MemAvailable: %llu kB", &kib) == 1) {
+                fclose(f);
+                return kib * 1024;
+            }
+        }
+        fclose(f);
+    }
+    return pages > 0 && page > 0 ? (uint64_t) pages * page : 0;
+}
+
+static double distinct_words(uint64_t bytes) {
+    return HEAPS_WORDS * pow(bytes / HEAPS_BYTES, HEAPS_BETA);
+}
+
+/*
+ * Fills in PLAN's estimates, leaving out chunks unless CHUNKS. Returns false
+ * if the input size is unknown.
+ */
+static bool estimate(struct word_engine_plan *plan, char *files[], int nfiles,
+                     bool chunks) {
+    struct stat st;
+    uint64_t largest = 0;
+    double merged = 0, table, count_ns, longest_ns;
+    int c = plan->cpus, p = nfiles < c ? nfiles : c, i;
+
+    if (nfiles == 0) {
+        if (fstat(STDIN_FILENO, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return false;
+        }
+        plan->bytes = largest = st.st_size;
+    }
+    for (i = 0; i < nfiles; i++) {
+        if (stat(files[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            plan->bytes = 0;
+            return false;
+        }
+        plan->bytes += st.st_size;
+        if ((uint64_t) st.st_size > largest) {
+            largest = st.st_size;
+        }
+        merged += distinct_words(st.st_size);
+    }
+    table = merged * TABLE_BYTES_PER_WORD;
+    count_ns = plan->bytes * NS_PER_BYTE;
+    longest_ns = largest * NS_PER_BYTE;
+
+    plan->ms[ENGINE_SINGLE] = count_ns / 1e6;
+    if (nfiles >= 2) {
+        /*
+         * Threads tokenize in parallel but take turns at the table; assumed
+         * to scale perfectly otherwise.
+         */
+        plan->ms[ENGINE_FILES] =
+            (nfiles * THREAD_NS +
+             fmax(longest_ns,
+                  count_ns * ((1 - LOOKUP_SHARE) / p + LOOKUP_SHARE))) /
+            1e6;
+    }
+    if (chunks) {
+        /*
+         * The slower of the tokenizing and the lookup stages sets the pace,
+         * as long as there are CPUs enough to run them side by side. Both
+         * the split and the even spread over CPUs are assumptions.
+         */
+        struct word_pipeline_config config;
+        word_pipeline_default(&config);
+        plan->ms[ENGINE_CHUNKS] =
+            ((config.readers + config.tokenizers + config.aggregators) *
+                 THREAD_NS +
+             count_ns * PIPELINE_SLOWDOWN *
+                 fmax(1.0 / c, fmax((1 - LOOKUP_SHARE) / config.tokenizers,
+                                    LOOKUP_SHARE / config.aggregators))) /
+            1e6;
+    }
+    if (nfiles >= 2 && (plan->memory == 0 || table <= plan->memory / 2)) {
+        /*
+         * Children count on their own, but the parent merges alone. That
+         * they divide the counting evenly over the CPUs is assumed.
+         */
+        plan->ms[ENGINE_PROCESSES] =
+            (nfiles * FORK_NS + fmax(longest_ns, count_ns / c) +
+             merged * MERGE_NS_PER_WORD) /
+            1e6;
+    }
+    return true;
+}
+
+void word_engine_plan(struct word_engine_plan *plan, char *files[],
+                      int nfiles) {
+    /* --aio and --io do their own reading, which the pipeline cannot. */
+    bool chunks = word_options_aio < 0 && word_io_mode == WORD_IO_STDIO;
+    bool known;
+    int e;
+
+    memset(plan, 0, sizeof(*plan));
+    plan->cpus = word_numa_cpus();
+    plan->memory = available_memory();
+    plan->nfiles = nfiles;
+    for (e = 0; e < NUM_ENGINES; e++) {
+        plan->ms[e] = -1;
+    }
+    known = estimate(plan, files, nfiles, chunks);
+
+    /*
+     * The compact table is the fastest in bench_* at every size tried, from
+     * 100 to 632008 distinct words: the lists cost about 2 ns per distinct
+     * word per lookup, and the radix tree 1.3 to 1.8 times as much.
+     */
+    plan->backend = word_options_backend != NULL  ? word_options_backend
+                    : word_options_prefix != NULL ? "art"
+                                                  : "compact";
+    if (word_options_prefix != NULL) {
+        plan->engine = ENGINE_SINGLE;
+        plan->reason = "--prefix is words only";
+    } else if (word_options_pipeline.readers > 0) {
+        plan->engine = ENGINE_CHUNKS;
+        plan->reason = "as --pipeline asks";
+    } else if (word_options_numa) {
+        plan->engine = ENGINE_FILES;
+        plan->reason = "--numa is pwords only";
+    } else if (plan->cpus > CALIBRATED_CPUS) {
+        plan->engine = ENGINE_SINGLE;
+        plan->reason = "parallel estimates uncalibrated for this many CPUs";
+    } else if (!known) {
+        plan->engine =
+            plan->cpus > 1 && chunks ? ENGINE_CHUNKS : ENGINE_SINGLE;
+        plan->reason = "input size unknown";
+    } else {
+        plan->engine = ENGINE_SINGLE;
+        for (e = 0; e < NUM_ENGINES; e++) {
+            if (plan->ms[e] >= 0 && plan->ms[e] < plan->ms[plan->engine]) {
+                plan->engine = e;
+            }
+        }
+    }
+}
+
+void word_engine_print(FILE *outfile, const char *prog,
+                       const struct word_engine_plan *plan) {
+    int e;
+
+    fprintf(outfile, "%s: ", prog);
+    if (plan->nfiles == 0) {
+        fprintf(outfile, "stdin");
+    } else {
+        fprintf(outfile, "%d file%s", plan->nfiles,
+                plan->nfiles == 1 ? "" : "s");
+    }
+    if (plan->bytes != 0) {
+        fprintf(outfile, ", %.1f MiB", plan->bytes / 1048576.0);
+    }
+    fprintf(outfile, ", %d CPU%s", plan->cpus, plan->cpus == 1 ? "" : "s");
+    if (plan->memory != 0) {
+        fprintf(outfile, ", %.1f GiB available",
+                plan->memory / 1073741824.0);
+    }
+    fprintf(outfile, "\n");
+    if (plan->ms[ENGINE_SINGLE] >= 0) {
+        fprintf(outfile, "%s: estimated", prog);
+        for (e = 0; e < NUM_ENGINES; e++) {
+            if (plan->ms[e] >= 0) {
+                fprintf(outfile, " %s %.1f ms", engine_names[e], plan->ms[e]);
+            } else {
+                fprintf(outfile, " %s -", engine_names[e]);
+            }
+            fprintf(outfile, e + 1 < NUM_ENGINES ? "," : "\n");
+        }
+    }
+    fprintf(outfile, "%s: %s engine (%s) on the %s table, %s\n", prog,
+            engine_names[plan->engine], engine_programs[plan->engine],
+            plan->backend, plan->reason ? plan->reason : "fastest estimate");
+}
@@ -0,0 +1,58 @@
+/*
+ * The word_engine interface picks how to count a set of inputs for
+ * autowords: which frontend runs, with how many threads or processes, and
+ * on which word_backend table.
+ *
+ * Engines are single (words), files (pwords, a thread per file on one
+ * shared table), chunks (pwords --pipeline, chunks dealt to tokenizers and
+ * hash-partitioned aggregators) and processes (fwords, a process and table
+ * per file, merged through pipes). The planner stats the inputs, counts the
+ * CPUs it may run on and reads the available memory, then estimates each
+ * engine's time with a cost model, and takes the fastest engine the command
+ * line allows. The model's single-threaded costs were measured with the
+ * benchmark suite and the frontends on one CPU; how the engines scale over
+ * more CPUs is assumed, not calibrated, so on more CPUs than it has been
+ * calibrated for the planner keeps to the single engine (see word_engine.c).
+ */
+
+#ifndef WORD_ENGINE_H
+#define WORD_ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum word_engine {
+    ENGINE_SINGLE,
+    ENGINE_FILES,
+    ENGINE_CHUNKS,
+    ENGINE_PROCESSES,
+    NUM_ENGINES
+};
+
+struct word_engine_plan {
+    enum word_engine engine;
+    const char *backend; /* The table: a word_backend name. */
+    const char *reason;  /* Why ENGINE, if not the model's estimate. */
+    int cpus;
+    uint64_t memory; /* Available memory in bytes, 0 if unknown. */
+    int nfiles;      /* 0 for stdin. */
+    uint64_t bytes;  /* Size of all inputs, 0 if unknown. */
+    double ms[NUM_ENGINES]; /* Estimated time, or -1 if ENGINE cannot run. */
+};
+
+/* The frontend that runs ENGINE. */
+const char *word_engine_program(enum word_engine engine);
+
+/*
+ * Plans how to count the NFILES files in FILES, or stdin if NFILES is 0,
+ * under the options word_options_parse has applied.
+ */
+void word_engine_plan(struct word_engine_plan *plan, char *files[],
+                      int nfiles);
+
+/* Prints PLAN's inputs, estimates and choice, one line each. */
+void word_engine_print(FILE *outfile, const char *prog,
+                       const struct word_engine_plan *plan);
+
+#endif /* WORD_ENGINE_H */
@@ -0,0 +1,61 @@
+/*
+ * Hashing of words for hash-based word count tables.
+ *
+ * word_hash() is a polynomial hash, h = sum(c[i] * M^(n-1-i)) mod 2^64, so it
+ * can be computed one byte at a time (word_hash_step) and the hash of a
+ * concatenation can be derived from the hashes of its parts
+ * (word_hash_concat). Its low bits are weak, so tables index buckets with
+ * word_hash_mix() of it.
+ */
+
+#ifndef WORD_HASH_H
+#define WORD_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WORD_HASH_MUL 0x100000001b3ull
+
+static inline uint64_t word_hash_step(uint64_t h, unsigned char c) {
+    return h * WORD_HASH_MUL + c;
+}
+
+static inline uint64_t word_hash(const char *word, size_t len) {
+    uint64_t h = 0;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h = word_hash_step(h, (unsigned char) word[i]);
+    }
+    return h;
+}
+
+/* Returns WORD_HASH_MUL^n, the factor that appends n bytes to a hash. */
+static inline uint64_t word_hash_pow(size_t n) {
+    uint64_t result = 1, base = WORD_HASH_MUL;
+    while (n != 0) {
+        if (n & 1) {
+            result *= base;
+        }
+        base *= base;
+        n >>= 1;
+    }
+    return result;
+}
+
+/* Hash of A followed by B, where B_POW is word_hash_pow(length of B). */
+static inline uint64_t word_hash_concat(uint64_t a, uint64_t b,
+                                        uint64_t b_pow) {
+    return a * b_pow + b;
+}
+
+/* Finalizer (from MurmurHash3) spreading all bits of H over the result. */
+static inline uint64_t word_hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+#endif /* WORD_HASH_H */
@@ -28,72 +28,627 @@
 #include <stdio.h>
 
 #include "word_count.h"
+#include "word_hash.h"
+#include "word_hll.h"
+#include "word_io.h"
+#include "word_mem.h"
+#include "word_progress.h"
+#include "word_stats.h"
+#include "word_trace.h"
+#include "word_utf8.h"
+
+enum tokenizer_mode count_words_mode = TOKENIZE_ASCII;
+int count_words_ngram = 1;
+
+/* Size of the blocks read from a FILE * by count_words. */
+#define READ_BLOCK_SIZE 65536
+
+/*
+ * Buffered input stream over a word_source. Reading whole blocks avoids the
+ * per-character locking of fgetc and lets the read phase be timed separately
+ * from tokenization.
+ */
+struct word_reader {
+    struct word_source *src;
+    const unsigned char *buf;
+    size_t pos;
+    size_t len;
+    bool eof; /* SRC has ended and must not be asked again. */
+};
+
+/*
+ * Refills the reader's buffer. Returns the next character, or EOF, and EOF
+ * again on every later call.
+ */
+static int reader_fill(struct word_reader *rd) {
+    struct word_timer t;
+    if (rd->eof) {
+        return EOF;
+    }
+    word_progress_poll();
+    word_timer_start(&t);
+    if (!rd->src->next(rd->src, &rd->buf, &rd->len)) {
+        rd->len = 0;
+        rd->eof = true;
+    }
+    rd->pos = 0;
+    word_timer_stop(&t, PHASE_READ);
+    WORD_STATS_ADD(bytes, rd->len);
+    word_progress_add(rd->len, 0);
+    return rd->len == 0 ? EOF : rd->buf[rd->pos++];
+}
+
+static inline int reader_getc(struct word_reader *rd) {
+    if (rd->pos < rd->len) {
+        return rd->buf[rd->pos++];
+    }
+    return reader_fill(rd);
+}
+
+/* Pushes back the character last returned by reader_getc, which was not
+ * EOF. It is still in the buffer, even right after a refill. */
+static inline void reader_ungetc(struct word_reader *rd) {
+    rd->pos--;
+}
+
+/*
+ * Lowercase form of each ASCII letter, 0 for every other byte. Equivalent to
+ * isalpha/tolower in the C locale, without the calls.
+ */
+#define LETTER_PAIR(U) [U] = (U) + 32, [(U) + 32] = (U) + 32
+static const unsigned char ascii_fold[256] = {
+    LETTER_PAIR('A'), LETTER_PAIR('B'), LETTER_PAIR('C'), LETTER_PAIR('D'),
+    LETTER_PAIR('E'), LETTER_PAIR('F'), LETTER_PAIR('G'), LETTER_PAIR('H'),
+    LETTER_PAIR('I'), LETTER_PAIR('J'), LETTER_PAIR('K'), LETTER_PAIR('L'),
+    LETTER_PAIR('M'), LETTER_PAIR('N'), LETTER_PAIR('O'), LETTER_PAIR('P'),
+    LETTER_PAIR('Q'), LETTER_PAIR('R'), LETTER_PAIR('S'), LETTER_PAIR('T'),
+    LETTER_PAIR('U'), LETTER_PAIR('V'), LETTER_PAIR('W'), LETTER_PAIR('X'),
+    LETTER_PAIR('Y'), LETTER_PAIR('Z'),
+};
+#undef LETTER_PAIR
+
+/*
+ * A growable buffer reused from word to word, so that tokenizing only
+ * allocates when a word is longer than any before it.
+ */
+struct word_scratch {
+    char *buf;
+    size_t cap;
+};
+
+/* Initial size of a scratch buffer. */
+#define SCRATCH_MIN 64
+
+/* Makes room for at least NEED bytes in S. Returns false if out of memory. */
+static bool scratch_reserve(struct word_scratch *s, size_t need) {
+    size_t cap = s->cap ? s->cap : SCRATCH_MIN;
+    char *buf;
+
+    if (need <= s->cap) {
+        return true;
+    }
+    while (cap < need) {
+        cap *= 2;
+    }
+    if ((buf = realloc(s->buf, cap)) == NULL) {
+        perror("realloc");
+        return false;
+    }
+    WORD_STATS_ADD(allocs, 1);
+    word_mem_account(MEM_IO, (long long) (cap - s->cap));
+    s->buf = buf;
+    s->cap = cap;
+    return true;
+}
+
+static void scratch_free(struct word_scratch *s) {
+    free(s->buf);
+    word_mem_account(MEM_IO, -(long long) s->cap);
+}
 
 /*
  * Reads a word from a stream, skipping initial non-alpha characters, and
- * stores it in a malloc'd buffer. Returns length of the word, or 0 if reached
- * end of file.
+ * stores it in SCRATCH, pointed to by TOK, hashing it as it is lowercased.
+ * Returns length of the word, or 0 if reached end of file.
  */
-static size_t get_word(char **word, FILE *infile) {
+static size_t get_word(word_token_t *tok, struct word_reader *rd,
+                       struct word_scratch *scratch) {
     int ch;
-    size_t buffer_cap = 16;
     size_t index = 0;
-    char *buffer;
+    uint64_t hash = 0;
 
     /* Skip initial non-alpha characters. */
-    while (!isalpha(ch = fgetc(infile))) {
+    while ((ch = reader_getc(rd)) == EOF || ascii_fold[ch] == 0) {
         if (ch == EOF) {
             return 0;
         }
     }
 
-    /* Allocate buffer on heap. */
-    if ((buffer = malloc(buffer_cap * sizeof(char))) == NULL) {
-        perror("malloc");
-        return 0;
+    /* Accumulate word's characters into the scratch buffer. */
+    do {
+        /* Expand buffer if full, keeping room for the NUL. */
+        if (index + 1 >= scratch->cap &&
+            !scratch_reserve(scratch, index + 2)) {
+            return 0;
+        }
+        scratch->buf[index++] = ascii_fold[ch];
+        hash = word_hash_step(hash, ascii_fold[ch]);
+    } while ((ch = reader_getc(rd)) != EOF && ascii_fold[ch] != 0);
+    scratch->buf[index] = '\0';
+
+    tok->word = scratch->buf;
+    tok->len = index;
+    tok->hash = hash;
+    return index;
+}
+
+/*
+ * Returns the number of continuation bytes that follow UTF-8 lead byte CH,
+ * storing its payload bits in *CP, or -1 if CH cannot start a sequence:
+ * continuation bytes, the overlong leads 0xc0 and 0xc1, and 0xf5 to 0xff.
+ */
+static inline int utf8_lead(int ch, int32_t *cp) {
+    if (ch >= 0xf0 && ch <= 0xf4) {
+        *cp = ch & 0x07;
+        return 3;
+    } else if (ch >= 0xe0 && ch <= 0xef) {
+        *cp = ch & 0x0f;
+        return 2;
+    } else if (ch >= 0xc2 && ch <= 0xdf) {
+        *cp = ch & 0x1f;
+        return 1;
+    }
+    return -1;
+}
+
+/*
+ * Whether CP, decoded from a lead byte and NEED continuation bytes, is a
+ * code point UTF-8 may encode that way: not overlong, not a UTF-16
+ * surrogate and not past U+10FFFF. Two-byte forms are never overlong once
+ * utf8_lead has refused 0xc0 and 0xc1.
+ */
+static inline bool utf8_valid(int32_t cp, int need) {
+    switch (need) {
+    case 2:
+        return cp >= 0x800 && (cp < 0xd800 || cp > 0xdfff);
+    case 3:
+        return cp >= 0x10000 && cp <= 0x10ffff;
+    default:
+        return true;
+    }
+}
+
+/*
+ * Decodes the UTF-8 sequence starting with byte CH. Returns its code point,
+ * or -1 if the sequence is malformed, in which case only CH is consumed, or
+ * if it is complete but encodes an overlong form, a surrogate or a code
+ * point past U+10FFFF.
+ */
+static int32_t reader_decode(struct word_reader *rd, int ch) {
+    int32_t cp;
+    int need, i;
+
+    if ((need = utf8_lead(ch, &cp)) < 0) {
+        return -1;
+    }
+    for (i = 0; i < need; i++) {
+        int next = reader_getc(rd);
+        if (next == EOF || (next & 0xc0) != 0x80) {
+            if (next != EOF) {
+                reader_ungetc(rd);
+            }
+            return -1;
+        }
+        cp = (cp << 6) | (next & 0x3f);
+    }
+    return utf8_valid(cp, need) ? cp : -1;
+}
+
+/* Returns the folded letter at CH (reading any continuation bytes), or 0 if
+ * CH does not start a letter. */
+static inline uint32_t next_letter(struct word_reader *rd, int ch) {
+    int32_t cp;
+    if (ch < 0x80) {
+        return ascii_fold[ch];
     }
+    cp = reader_decode(rd, ch);
+    return cp < 0 ? 0 : utf8_fold(cp);
+}
+
+/*
+ * UTF-8 version of get_word: words are runs of Unicode letters, folded to
+ * lower case. ASCII bytes take the same table lookup as get_word. Returns the
+ * length of the word in characters, or 0 if reached end of file.
+ */
+static size_t get_word_utf8(word_token_t *tok, struct word_reader *rd,
+                            struct word_scratch *scratch) {
+    int ch;
+    uint32_t letter;
+    size_t index = 0;
+    size_t chars = 0;
+    uint64_t hash = 0;
+    char *buffer;
+
+    /* Skip initial non-letters. */
+    do {
+        if ((ch = reader_getc(rd)) == EOF) {
+            return 0;
+        }
+    } while ((letter = next_letter(rd, ch)) == 0);
 
-    /* Accumulate word's characters into buffer. */
     do {
-        buffer[index++] = tolower(ch);
-
-        /* Expand buffer if full. */
-        if (index == buffer_cap) {
-            char *new_buffer;
-            buffer_cap *= 2;
-            if ((new_buffer = realloc(buffer, buffer_cap)) == NULL) {
-                perror("realloc");
-                free(buffer);
-                return 0;
+        /* Keep room for a four-byte character and the NUL. */
+        if (index + 5 > scratch->cap && !scratch_reserve(scratch, index + 5)) {
+            return 0;
+        }
+        buffer = scratch->buf;
+        if (letter < 0x80) {
+            buffer[index++] = letter;
+            hash = word_hash_step(hash, letter);
+        } else {
+            size_t start = index;
+            index += utf8_encode(letter, buffer + index);
+            for (; start < index; start++) {
+                hash = word_hash_step(hash, buffer[start]);
             }
-            buffer = new_buffer;
         }
-    } while (isalpha(ch = fgetc(infile)));
-    buffer[index] = '\0';
+        chars++;
+    } while ((ch = reader_getc(rd)) != EOF &&
+             (letter = next_letter(rd, ch)) != 0);
+    scratch->buf[index] = '\0';
 
-    *word = buffer;
-    return index;
+    tok->word = scratch->buf;
+    tok->len = index;
+    tok->hash = hash;
+    return chars;
+}
+
+/*
+ * Reads the next word into TOK with the tokenizer selected by
+ * count_words_mode. Returns its length in characters, or 0 at end of file.
+ */
+static inline size_t next_word(word_token_t *tok, struct word_reader *rd,
+                               struct word_scratch *scratch) {
+    return count_words_mode == TOKENIZE_UTF8 ? get_word_utf8(tok, rd, scratch)
+                                             : get_word(tok, rd, scratch);
+}
+
+/*
+ * The last count_words_ngram words of a stream. Each word keeps its hash, so
+ * the hash of an n-gram is combined from the hashes of its words
+ * (word_hash_concat) instead of rescanning the joined key. Every slot keeps
+ * its own copy of its word, and n-grams are joined in one more buffer, all
+ * reused as the window slides.
+ */
+struct ngram_window {
+    int n;
+    int filled;
+    int head; /* Index of the oldest word. */
+    struct {
+        word_token_t tok;
+        uint64_t pow; /* word_hash_pow(tok.len) */
+        struct word_scratch copy;
+    } words[NGRAM_MAX];
+    struct word_scratch joined;
+};
+
+/*
+ * Appends a copy of TOK, and once N words are buffered passes the n-gram they
+ * form, joined by single spaces, to SINK. Returns false if the n-gram could
+ * not be added.
+ */
+static bool ngram_push(struct ngram_window *w, struct word_sink *sink,
+                       const word_token_t *tok) {
+    int slot = (w->head + w->filled) % w->n;
+    size_t total = w->n - 1;
+    size_t pos = 0;
+    uint64_t hash = 0;
+    word_token_t joined;
+    char *buf;
+    int i;
+
+    if (w->filled == w->n) {
+        w->head = (w->head + 1) % w->n;
+    } else {
+        w->filled++;
+    }
+    if (!scratch_reserve(&w->words[slot].copy, tok->len + 1)) {
+        return false;
+    }
+    memcpy(w->words[slot].copy.buf, tok->word, tok->len + 1);
+    w->words[slot].tok = *tok;
+    w->words[slot].tok.word = w->words[slot].copy.buf;
+    w->words[slot].pow = word_hash_pow(tok->len);
+    if (w->filled < w->n) {
+        return true;
+    }
+
+    for (i = 0; i < w->n; i++) {
+        total += w->words[i].tok.len;
+    }
+    if (!scratch_reserve(&w->joined, total + 1)) {
+        return false;
+    }
+    buf = w->joined.buf;
+    for (i = 0; i < w->n; i++) {
+        int j = (w->head + i) % w->n;
+        const word_token_t *part = &w->words[j].tok;
+        if (i > 0) {
+            buf[pos++] = ' ';
+            hash = word_hash_step(hash, ' ');
+        }
+        memcpy(buf + pos, part->word, part->len);
+        pos += part->len;
+        hash = word_hash_concat(hash, part->hash, w->words[j].pow);
+    }
+    buf[pos] = '\0';
+    joined.word = buf;
+    joined.len = pos;
+    joined.hash = hash;
+    return sink->add(sink, &joined);
+}
+
+size_t word_split_point(const unsigned char *buf, size_t len) {
+    while (len > 0 && (buf[len - 1] >= 0x80 || ascii_fold[buf[len - 1]] != 0)) {
+        len--;
+    }
+    return len;
+}
+
+/*
+ * Steps *POS back over the character that ends there, as the tokenizer
+ * selected by count_words_mode would have read it going forward. Returns
+ * the folded letter, or 0 if it is not one.
+ */
+static uint32_t letter_before(const unsigned char *buf, size_t *pos) {
+    size_t end = --*pos, start = end;
+    int32_t cp;
+    int need, i;
+
+    if (buf[end] < 0x80 || count_words_mode != TOKENIZE_UTF8) {
+        return ascii_fold[buf[end]];
+    }
+    while (start > 0 && end - start < 3 && (buf[start] & 0xc0) == 0x80) {
+        start--;
+    }
+    if ((need = utf8_lead(buf[start], &cp)) < 0 || start + need != end) {
+        return 0;
+    }
+    for (i = 1; i <= need; i++) {
+        if ((buf[start + i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        cp = (cp << 6) | (buf[start + i] & 0x3f);
+    }
+    if (!utf8_valid(cp, need)) {
+        return 0;
+    }
+    *pos = start;
+    return utf8_fold(cp);
+}
+
+size_t word_tail_start(const unsigned char *buf, size_t len, int words,
+                       int *found) {
+    size_t pos = len, start = len, save;
+    size_t chars;
+
+    *found = 0;
+    while (*found < words) {
+        /* Skip back to the end of a word, then to its start. */
+        while (pos > 0) {
+            save = pos;
+            if (letter_before(buf, &pos) != 0) {
+                pos = save;
+                break;
+            }
+        }
+        if (pos == 0) {
+            break;
+        }
+        for (chars = 0; pos > 0; chars++) {
+            save = pos;
+            if (letter_before(buf, &pos) == 0) {
+                pos = save;
+                break;
+            }
+        }
+        /* One-letter words are skipped, so they do not count either. */
+        if (chars > 1) {
+            (*found)++;
+            start = pos;
+        }
+    }
+    return start;
+}
+
+/* word_source reading a stdio stream. */
+struct file_source {
+    struct word_source src;
+    FILE *infile;
+    unsigned char buf[READ_BLOCK_SIZE];
+};
+
+static bool file_source_next(struct word_source *src, const unsigned char **buf,
+                             size_t *len) {
+    struct file_source *fs = (struct file_source *) src;
+    *buf = fs->buf;
+    *len = fread(fs->buf, 1, sizeof(fs->buf), fs->infile);
+    return *len != 0;
+}
+
+/* Words count_words collects for each add_words_batch call. */
+#define WORD_BATCH 64
+/* Bytes of the words of one batch; a batch is added early when it is full. */
+#define WORD_ARENA 4096
+
+/*
+ * word_sink adding to a word count list in batches of WORD_BATCH. The
+ * tokenizer reuses its buffer, so the words of a batch are copied into
+ * ARENA until the batch is added.
+ */
+struct list_sink {
+    struct word_sink sink;
+    word_count_list_t *wclist;
+    size_t n;
+    size_t used; /* Bytes of ARENA in use. */
+    word_token_t batch[WORD_BATCH];
+    char arena[WORD_ARENA];
+};
+
+/* Adds the sink's pending batch. Returns false if any word was dropped. */
+static bool list_sink_flush(struct list_sink *ls) {
+    size_t n = ls->n, added;
+    uint64_t start, end, cpu = 0, perf[NUM_PERF_EVENTS];
+
+    ls->n = 0;
+    ls->used = 0;
+    word_progress_add(0, n);
+    if (!word_stats_enabled && !word_trace_enabled) {
+        return add_words_batch(ls->wclist, ls->batch, n) == n;
+    }
+    if (word_perf_enabled) {
+        word_perf_read(perf);
+    }
+    if (word_stats_enabled) {
+        cpu = word_thread_cpu_ns();
+    }
+    start = word_now_ns();
+    added = add_words_batch(ls->wclist, ls->batch, n);
+    end = word_now_ns();
+    if (word_perf_enabled) {
+        word_perf_add(word_stats_local.perf[PHASE_LOOKUP], perf);
+    }
+    if (word_stats_enabled) {
+        word_stats_local.cpu_ns[PHASE_LOOKUP] += word_thread_cpu_ns() - cpu;
+        word_stats_local.wall_ns[PHASE_LOOKUP] += end - start;
+        word_stats_local.tokens += n;
+    }
+    word_trace_record("insert batch", start, end);
+    return added == n;
+}
+
+static bool list_sink_add(struct word_sink *sink, const word_token_t *tok) {
+    struct list_sink *ls = (struct list_sink *) sink;
+    bool ok = true;
+
+    if (word_hll_input != NULL) {
+        word_hll_add(word_hll_input, tok->hash);
+    }
+    if (ls->used + tok->len + 1 > WORD_ARENA) {
+        ok = list_sink_flush(ls);
+        if (tok->len + 1 > WORD_ARENA) {
+            /* Too long to copy; add it on its own while it is still valid. */
+            ls->batch[ls->n++] = *tok;
+            return list_sink_flush(ls) && ok;
+        }
+    }
+    memcpy(ls->arena + ls->used, tok->word, tok->len + 1);
+    ls->batch[ls->n] = *tok;
+    ls->batch[ls->n++].word = ls->arena + ls->used;
+    ls->used += tok->len + 1;
+    return (ls->n < WORD_BATCH || list_sink_flush(ls)) && ok;
 }
 
 void count_words(word_count_list_t *wclist, FILE *infile) {
-    /* Extract all words in infile and update word counts for them. */
-    char *word;
+    struct word_source *src;
+    struct file_source *fs;
+
+    if ((src = word_io_open(fileno(infile))) != NULL) {
+        count_words_source(wclist, src);
+        word_io_close(src);
+        return;
+    }
+
+    if ((fs = malloc(sizeof(*fs))) == NULL) {
+        perror("malloc");
+        return;
+    }
+    word_mem_account(MEM_IO, sizeof(*fs));
+    fs->src.next = file_source_next;
+    fs->infile = infile;
+    word_mem_advise_input(fileno(infile));
+    count_words_source(wclist, &fs->src);
+    free(fs);
+    word_mem_account(MEM_IO, -(long long) sizeof(*fs));
+}
+
+void count_words_source(word_count_list_t *wclist, struct word_source *src) {
+    struct list_sink ls = {{list_sink_add}, wclist, 0, 0};
+    if (word_hll_enabled) {
+        word_hll_begin_input();
+    }
+    tokenize_source(src, &ls.sink);
+    list_sink_flush(&ls);
+    if (word_hll_enabled) {
+        word_hll_end_input();
+    }
+    word_stats_flush();
+}
+
+void tokenize_source(struct word_source *src, struct word_sink *sink) {
+    /* Extract all words in src and pass them on to sink. */
+    struct word_stats *l = &word_stats_local;
+    struct word_reader reader = {src, NULL, 0, 0, false};
+    struct word_reader *rd = &reader;
+    struct word_timer t;
+    uint64_t read_wall, read_cpu, lookup_wall, lookup_cpu;
+    uint64_t read_perf[NUM_PERF_EVENTS], lookup_perf[NUM_PERF_EVENTS];
+    struct ngram_window window = {.n = count_words_ngram};
+    struct word_scratch scratch = {NULL, 0};
+    word_token_t tok;
     size_t len;
-    while ((len = get_word(&word, infile)) != 0) {
+    int i;
+
+    read_wall = l->wall_ns[PHASE_READ];
+    read_cpu = l->cpu_ns[PHASE_READ];
+    lookup_wall = l->wall_ns[PHASE_LOOKUP];
+    lookup_cpu = l->cpu_ns[PHASE_LOOKUP];
+    memcpy(read_perf, l->perf[PHASE_READ], sizeof(read_perf));
+    memcpy(lookup_perf, l->perf[PHASE_LOOKUP], sizeof(lookup_perf));
+    word_timer_start(&t);
+    while ((len = next_word(&tok, rd, &scratch)) != 0) {
         if (len == 1) {
-            free(word);
-        } else if (add_word(wclist, word) == NULL) {
-            free(word);
-            return;
+            WORD_STATS_ADD(short_tokens, 1);
+        } else if (window.n > 1) {
+            /* N-grams are formed from the same words unigrams count, and
+             * never span two streams. */
+            if (!ngram_push(&window, sink, &tok)) {
+                break;
+            }
+        } else if (!sink->add(sink, &tok)) {
+            break;
+        }
+    }
+    word_timer_stop(&t, PHASE_TOKENIZE);
+    for (i = 0; i < window.n; i++) {
+        scratch_free(&window.words[i].copy);
+    }
+    scratch_free(&window.joined);
+    scratch_free(&scratch);
+
+    if (word_stats_enabled) {
+        /*
+         * The loop above was timed as a whole; take out the time already
+         * attributed to reading and lookups so each phase is counted once.
+         */
+        l->wall_ns[PHASE_TOKENIZE] -= (l->wall_ns[PHASE_READ] - read_wall) +
+                                      (l->wall_ns[PHASE_LOOKUP] - lookup_wall);
+        l->cpu_ns[PHASE_TOKENIZE] -= (l->cpu_ns[PHASE_READ] - read_cpu) +
+                                     (l->cpu_ns[PHASE_LOOKUP] - lookup_cpu);
+        for (i = 0; i < NUM_PERF_EVENTS; i++) {
+            l->perf[PHASE_TOKENIZE][i] -=
+                (l->perf[PHASE_READ][i] - read_perf[i]) +
+                (l->perf[PHASE_LOOKUP][i] - lookup_perf[i]);
         }
+        word_stats_flush();
     }
 }
 
 bool less_count(const word_count_t *wc1, const word_count_t *wc2) {
     return (wc1->count < wc2->count) ||
-           ((wc1->count == wc2->count) && (strcmp(wc1->word, wc2->word) < 0));
+           ((wc1->count == wc2->count) && (wc_compare_words(wc1, wc2) < 0));
 }
 
 bool less_word(const word_count_t *wc1, const word_count_t *wc2) {
-    return strcmp(wc1->word, wc2->word) < 0;
+    return wc_compare_words(wc1, wc2) < 0;
 }
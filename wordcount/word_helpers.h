@@ -30,12 +30,74 @@
 
 #include "word_count.h"
 
+/* How count_words splits input into words. */
+enum tokenizer_mode {
+    TOKENIZE_ASCII, /* Runs of ASCII letters (the default). */
+    TOKENIZE_UTF8,  /* Runs of Unicode letters in UTF-8, case-folded. */
+};
+
+extern enum tokenizer_mode count_words_mode;
+
+/*
+ * Number of consecutive words count_words counts as one key, joined by
+ * single spaces: 1 (the default) counts words, 2 bigrams, and so on up to
+ * NGRAM_MAX.
+ */
+#define NGRAM_MAX 8
+extern int count_words_ngram;
+
 /*
  * Reads all words from a stream and updates a word count list with their
  * counts.
  */
 void count_words(word_count_list_t *wclist, FILE *infile);
 
+/* A source of input blocks for count_words_source. */
+struct word_source {
+    /*
+     * Sets *BUF and *LEN to the next block of input and returns true, or
+     * returns false at the end of input. A block stays valid until the next
+     * call.
+     */
+    bool (*next)(struct word_source *src, const unsigned char **buf,
+                 size_t *len);
+};
+
+/* Like count_words, reading from SRC. */
+void count_words_source(word_count_list_t *wclist, struct word_source *src);
+
+/* A consumer of the keys tokenize_source produces. */
+struct word_sink {
+    /*
+     * Consumes TOK, whose length and word_hash were computed while it was
+     * tokenized. TOK's word is only valid until ADD returns; the tokenizer
+     * reuses its buffer for the next word. Returns false to stop tokenizing.
+     */
+    bool (*add)(struct word_sink *sink, const word_token_t *tok);
+};
+
+/*
+ * Splits SRC into keys as count_words does, passing each to SINK instead of
+ * adding it to a list.
+ */
+void tokenize_source(struct word_source *src, struct word_sink *sink);
+
+/*
+ * Returns the length of the longest prefix of BUF[0, LEN) that ends at a
+ * word boundary in either tokenizer mode: just past the last ASCII byte that
+ * is not a letter. Returns 0 if there is none.
+ */
+size_t word_split_point(const unsigned char *buf, size_t len);
+
+/*
+ * Finds the last WORDS words of BUF[0, LEN) that tokenize_source would pass
+ * on, skipping one-letter words. Sets *FOUND to how many there are, up to
+ * WORDS, and returns the offset where the earliest of them starts, or LEN if
+ * there are none.
+ */
+size_t word_tail_start(const unsigned char *buf, size_t len, int words,
+                       int *found);
+
 /*
  * Returns true if the first entry has a lower count than the second entry,
  * breaking ties according to alphabetical order.
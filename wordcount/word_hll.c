@@ -0,0 +1,121 @@
+/*
+ * Implementation of the word_hll interface.
+ */
+
+#include "word_hll.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define REGISTERS (1 << WORD_HLL_BITS)
+
+bool word_hll_enabled = false;
+__thread struct word_hll *word_hll_input;
+
+/* Sketches of a thread's current input and of everything it counted. */
+struct thread_sketches {
+    struct word_hll input;
+    struct word_hll worker;
+};
+
+static __thread struct thread_sketches *sketches;
+static pthread_key_t sketches_key;
+static pthread_once_t sketches_once = PTHREAD_ONCE_INIT;
+
+static struct word_hll total;
+static size_t total_inputs;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void word_hll_enable(void) {
+    word_hll_enabled = true;
+}
+
+void word_hll_merge(struct word_hll *dst, const struct word_hll *src) {
+    size_t i;
+    for (i = 0; i < REGISTERS; i++) {
+        if (dst->reg[i] < src->reg[i]) {
+            dst->reg[i] = src->reg[i];
+        }
+    }
+}
+
+double word_hll_estimate(const struct word_hll *h) {
+    double m = REGISTERS, sum = 0, estimate;
+    size_t zeros = 0, i;
+
+    for (i = 0; i < REGISTERS; i++) {
+        sum += ldexp(1.0, -h->reg[i]);
+        zeros += h->reg[i] == 0;
+    }
+    estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    /* While many registers are still empty, counting them is more exact. */
+    if (estimate <= 2.5 * m && zeros != 0) {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
+}
+
+static void make_key(void) {
+    pthread_key_create(&sketches_key, free);
+}
+
+void word_hll_begin_input(void) {
+    if (sketches == NULL) {
+        if ((sketches = calloc(1, sizeof(*sketches))) == NULL) {
+            perror("calloc");
+            return;
+        }
+        /* Freed when the thread exits. */
+        pthread_once(&sketches_once, make_key);
+        pthread_setspecific(sketches_key, sketches);
+    }
+    memset(&sketches->input, 0, sizeof(sketches->input));
+    word_hll_input = &sketches->input;
+}
+
+void word_hll_end_input(void) {
+    if (word_hll_input == NULL) {
+        return;
+    }
+    word_hll_merge(&sketches->worker, word_hll_input);
+    word_hll_add_total(word_hll_input);
+}
+
+void word_hll_add_total(const struct word_hll *src) {
+    pthread_mutex_lock(&total_lock);
+    word_hll_merge(&total, src);
+    total_inputs++;
+    pthread_mutex_unlock(&total_lock);
+}
+
+void word_hll_print_input(FILE *outfile, const char *name) {
+    if (word_hll_enabled && word_hll_input != NULL) {
+        fprintf(outfile, "distinct:     ~%.0f words in %s\n",
+                word_hll_estimate(word_hll_input), name);
+    }
+}
+
+void word_hll_print_worker(FILE *outfile, const char *name) {
+    if (word_hll_enabled && sketches != NULL) {
+        fprintf(outfile, "distinct:     ~%.0f words seen by %s\n",
+                word_hll_estimate(&sketches->worker), name);
+    }
+}
+
+void word_hll_print_total(FILE *outfile, size_t exact) {
+    double estimate;
+
+    if (!word_hll_enabled || total_inputs == 0) {
+        return;
+    }
+    estimate = word_hll_estimate(&total);
+    fprintf(outfile, "distinct:     ~%.0f words merged from %zu sketch%s, "
+                     "%zu exact",
+            estimate, total_inputs, total_inputs == 1 ? "" : "es", exact);
+    if (exact != 0) {
+        fprintf(outfile, " (%+.2f%%)", 100 * (estimate - exact) / exact);
+    }
+    fprintf(outfile, "\n");
+}
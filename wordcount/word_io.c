@@ -0,0 +1,197 @@
+/*
+ * Implementation of the word_io interface.
+ */
+
+#define _GNU_SOURCE
+
+#include "word_io.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "word_mem.h"
+
+/* O_DIRECT buffers and block sizes are multiples of this, which covers the
+ * logical block size of common devices. */
+#define DIRECT_ALIGN 4096
+
+enum word_io_mode word_io_mode = WORD_IO_STDIO;
+size_t word_io_block = WORD_IO_BLOCK;
+
+/* Set once --io is given, so the strategy is only reported when chosen. */
+static bool io_chosen;
+
+static const char *const mode_names[] = {
+    [WORD_IO_STDIO] = "stdio",
+    [WORD_IO_READ] = "read",
+    [WORD_IO_MMAP] = "mmap",
+    [WORD_IO_DIRECT] = "direct",
+};
+
+struct io_source {
+    struct word_source src;
+    int fd;
+    int flags;          /* FD's status flags before O_DIRECT, or -1. */
+    unsigned char *buf; /* Read buffer, or the mapped file. */
+    size_t cap;         /* Size of the read buffer. */
+    size_t map_len;     /* Size of the mapped file, 0 if not mapped. */
+    bool mapped_done;   /* The mapping was returned. */
+};
+
+bool word_io_parse(const char *arg) {
+    size_t n = strcspn(arg, ":");
+    enum word_io_mode mode;
+    unsigned long long block;
+    char *end;
+
+    for (mode = WORD_IO_STDIO; mode <= WORD_IO_DIRECT; mode++) {
+        if (strlen(mode_names[mode]) == n &&
+            strncmp(arg, mode_names[mode], n) == 0) {
+            break;
+        }
+    }
+    if (mode > WORD_IO_DIRECT) {
+        return false;
+    }
+    if (arg[n] == ':') {
+        block = strtoull(arg + n + 1, &end, 10);
+        if (*end == 'K' || *end == 'k') {
+            block <<= 10;
+            end++;
+        } else if (*end == 'M' || *end == 'm') {
+            block <<= 20;
+            end++;
+        }
+        if (end == arg + n + 1 || *end != '\0' || block == 0) {
+            return false;
+        }
+        word_io_block = block;
+    }
+    word_io_mode = mode;
+    io_chosen = true;
+    return true;
+}
+
+static bool read_next(struct word_source *src, const unsigned char **buf,
+                      size_t *len) {
+    struct io_source *io = (struct io_source *) src;
+    ssize_t n;
+
+    while ((n = read(io->fd, io->buf, io->cap)) < 0) {
+        if (errno == EINVAL && io->flags >= 0) {
+            /* The file system refused direct I/O after all. */
+            fcntl(io->fd, F_SETFL, io->flags);
+            io->flags = -1;
+        } else if (errno != EINTR) {
+            perror("read");
+            return false;
+        }
+    }
+    *buf = io->buf;
+    *len = n;
+    return n > 0;
+}
+
+static bool map_next(struct word_source *src, const unsigned char **buf,
+                     size_t *len) {
+    struct io_source *io = (struct io_source *) src;
+    if (io->mapped_done) {
+        return false;
+    }
+    io->mapped_done = true;
+    *buf = io->buf;
+    *len = io->map_len;
+    return true;
+}
+
+struct word_source *word_io_open(int fd) {
+    enum word_io_mode mode = word_io_mode;
+    struct io_source *io;
+    struct stat st;
+    bool regular;
+    size_t cap;
+    void *p;
+
+    if (mode == WORD_IO_STDIO) {
+        return NULL;
+    }
+    if ((io = calloc(1, sizeof(*io))) == NULL) {
+        perror("calloc");
+        return NULL;
+    }
+    io->fd = fd;
+    io->flags = -1;
+    regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    /* Only a non-empty regular file can be mapped; read anything else. */
+    if (mode == WORD_IO_MMAP && regular && st.st_size > 0 &&
+        (p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) !=
+            MAP_FAILED) {
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        madvise(p, st.st_size, MADV_WILLNEED);
+        io->src.next = map_next;
+        io->buf = p;
+        io->map_len = st.st_size;
+        return &io->src;
+    }
+
+    cap = word_io_block;
+    if (mode == WORD_IO_DIRECT && regular) {
+        /* On a pipe O_DIRECT would mean packet mode, so files only. */
+        int flags = fcntl(fd, F_GETFL);
+        cap = (cap + DIRECT_ALIGN - 1) & ~(size_t) (DIRECT_ALIGN - 1);
+        if (flags >= 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0) {
+            io->flags = flags;
+        }
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (posix_memalign((void **) &io->buf, DIRECT_ALIGN, cap) != 0) {
+        perror("posix_memalign");
+        free(io);
+        return NULL;
+    }
+    io->src.next = read_next;
+    io->cap = cap;
+    word_mem_account(MEM_IO, cap);
+    return &io->src;
+}
+
+void word_io_close(struct word_source *src) {
+    struct io_source *io = (struct io_source *) src;
+
+    if (io->map_len != 0) {
+        munmap(io->buf, io->map_len);
+    } else {
+        free(io->buf);
+        word_mem_account(MEM_IO, -(long long) io->cap);
+    }
+    if (io->flags >= 0) {
+        fcntl(io->fd, F_SETFL, io->flags);
+    }
+    free(io);
+}
+
+void word_io_print(FILE *outfile, uint64_t bytes, uint64_t read_ns,
+                   uint64_t elapsed_ns) {
+    if (!io_chosen) {
+        return;
+    }
+    fprintf(outfile, "input:        %s", mode_names[word_io_mode]);
+    if (word_io_mode == WORD_IO_READ || word_io_mode == WORD_IO_DIRECT) {
+        fprintf(outfile, " (%zu KiB blocks)", word_io_block >> 10);
+    }
+    /* Bytes per nanosecond, times 1000, is MB/s. A mapping is read by the
+     * page faults of tokenizing, so only the overall rate means anything. */
+    if (read_ns != 0 && word_io_mode != WORD_IO_MMAP) {
+        fprintf(outfile, ", %.1f MB/s reading", bytes * 1e3 / read_ns);
+    }
+    if (elapsed_ns != 0) {
+        fprintf(outfile, ", %.1f MB/s overall", bytes * 1e3 / elapsed_ns);
+    }
+    fprintf(outfile, "\n");
+}
@@ -0,0 +1,53 @@
+/*
+ * The word_io interface selects how count_words reads its input files.
+ *
+ * By default input goes through stdio. --io picks a strategy instead:
+ * read() into a large buffer, mmap of the whole file, or O_DIRECT reads
+ * into page-aligned buffers that bypass the page cache. Buffered and direct
+ * reads are advised as sequential. An input the strategy cannot handle,
+ * such as a pipe for mmap, falls back to read().
+ */
+
+#ifndef WORD_IO_H
+#define WORD_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "word_helpers.h"
+
+enum word_io_mode {
+    WORD_IO_STDIO,
+    WORD_IO_READ,
+    WORD_IO_MMAP,
+    WORD_IO_DIRECT,
+};
+
+/* Default size of one read() for the read and direct strategies. */
+#define WORD_IO_BLOCK (1024 * 1024)
+
+extern enum word_io_mode word_io_mode;
+extern size_t word_io_block;
+
+/*
+ * Sets the strategy from ARG, "stdio", "read", "mmap" or "direct",
+ * optionally followed by ":SIZE" for the block size, with a K or M suffix.
+ * Returns false if ARG is invalid.
+ */
+bool word_io_parse(const char *arg);
+
+/*
+ * Returns a source reading FD with the selected strategy, or NULL if the
+ * strategy is stdio. The source does not close FD.
+ */
+struct word_source *word_io_open(int fd);
+
+void word_io_close(struct word_source *src);
+
+/* Prints the strategy and its throughput, given the run's totals. */
+void word_io_print(FILE *outfile, uint64_t bytes, uint64_t read_ns,
+                   uint64_t elapsed_ns);
+
+#endif /* WORD_IO_H */
@@ -0,0 +1,112 @@
+/*
+ * Word keys stored in word count entries.
+ *
+ * Words of up to WORD_INLINE_MAX bytes (most English words) are stored
+ * inline in two 64-bit words, NUL-padded, so they share the entry's cache
+ * line with its count and compare as integers. Longer words keep an
+ * out-of-line heap pointer. The length, kept alongside the key, tells the
+ * two forms apart.
+ */
+
+#ifndef WORD_KEY_H
+#define WORD_KEY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "word_mem.h"
+
+#define WORD_INLINE_MAX 15
+
+typedef union word_key {
+    char bytes[WORD_INLINE_MAX + 1]; /* len <= WORD_INLINE_MAX */
+    uint64_t packed[2];              /* bytes, as integers */
+    char *ptr;                       /* len > WORD_INLINE_MAX */
+} word_key_t;
+
+/* Loads a packed half so that integer order is lexicographic byte order. */
+static inline uint64_t word_key_order(uint64_t packed) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(packed);
+#else
+    return packed;
+#endif
+}
+
+/* Returns the NUL-terminated word held by KEY. */
+static inline const char *word_key_str(const word_key_t *key, uint32_t len) {
+    return len <= WORD_INLINE_MAX ? key->bytes : key->ptr;
+}
+
+/*
+ * Fills KEY with WORD of length LEN without taking ownership. For long words
+ * KEY borrows WORD, so it is only valid while WORD is.
+ */
+static inline void word_key_borrow(word_key_t *key, const char *word,
+                                   size_t len) {
+    if (len <= WORD_INLINE_MAX) {
+        key->packed[0] = key->packed[1] = 0;
+        memcpy(key->bytes, word, len);
+    } else {
+        key->ptr = (char *) word;
+    }
+}
+
+/*
+ * Stores a copy of WORD of length LEN in KEY, leaving WORD with the caller.
+ * Only long words need memory. Returns false if it cannot be allocated.
+ */
+static inline bool word_key_copy(word_key_t *key, const char *word,
+                                 size_t len) {
+    char *copy;
+    if (len <= WORD_INLINE_MAX) {
+        word_key_borrow(key, word, len);
+        return true;
+    }
+    if ((copy = malloc(len + 1)) == NULL) {
+        return false;
+    }
+    memcpy(copy, word, len);
+    copy[len] = '\0';
+    key->ptr = copy;
+    word_mem_account(MEM_STRINGS, len + 1);
+    return true;
+}
+
+/* Releases any out-of-line storage owned by KEY. */
+static inline void word_key_free(word_key_t *key, uint32_t len) {
+    if (len > WORD_INLINE_MAX) {
+        free(key->ptr);
+        word_mem_account(MEM_STRINGS, -(long long) (len + 1));
+    }
+}
+
+static inline bool word_key_equal(const word_key_t *a, uint32_t alen,
+                                  const word_key_t *b, uint32_t blen) {
+    if (alen != blen) {
+        return false;
+    }
+    if (alen <= WORD_INLINE_MAX) {
+        return a->packed[0] == b->packed[0] && a->packed[1] == b->packed[1];
+    }
+    return memcmp(a->ptr, b->ptr, alen) == 0;
+}
+
+/* Three-way comparison in strcmp order. */
+static inline int word_key_compare(const word_key_t *a, uint32_t alen,
+                                   const word_key_t *b, uint32_t blen) {
+    if (alen <= WORD_INLINE_MAX && blen <= WORD_INLINE_MAX) {
+        uint64_t x = word_key_order(a->packed[0]);
+        uint64_t y = word_key_order(b->packed[0]);
+        if (x == y) {
+            x = word_key_order(a->packed[1]);
+            y = word_key_order(b->packed[1]);
+        }
+        return (x > y) - (x < y);
+    }
+    return strcmp(word_key_str(a, alen), word_key_str(b, blen));
+}
+
+#endif /* WORD_KEY_H */
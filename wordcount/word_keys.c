@@ -0,0 +1,110 @@
+/*
+ * Implementation of the word_keys interface.
+ */
+
+#include "word_keys.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct word_zipf {
+    size_t n;
+    double cdf[]; /* cdf[i] is the weight of ranks 0 to i. */
+};
+
+void word_rng_seed(struct word_rng *rng, uint64_t seed) {
+    /* Zero is the one state xorshift never leaves. */
+    rng->state = seed != 0 ? seed : 1;
+}
+
+uint64_t word_rng_next(struct word_rng *rng) {
+    rng->state ^= rng->state >> 12;
+    rng->state ^= rng->state << 25;
+    rng->state ^= rng->state >> 27;
+    return rng->state * 0x2545f4914f6cdd1dull;
+}
+
+size_t word_rng_below(struct word_rng *rng, size_t n) {
+    return word_rng_next(rng) % n;
+}
+
+char **word_keys_make(struct word_rng *rng, size_t n, size_t min_len,
+                      size_t max_len) {
+    char **words = malloc(n * sizeof(char *));
+    size_t ndigits = 1, i, j, k;
+
+    if (words == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 26; i < n; i *= 26) {
+        ndigits++;
+    }
+    for (i = 0; i < n; i++) {
+        size_t len = min_len + word_rng_below(rng, max_len - min_len + 1);
+        size_t index = i;
+        if (len < ndigits) {
+            len = ndigits;
+        }
+        if ((words[i] = malloc(len + 1)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        for (j = 0; j < len - ndigits; j++) {
+            words[i][j] = 'a' + word_rng_below(rng, 26);
+        }
+        for (k = 0; k < ndigits; k++) {
+            words[i][j + k] = 'a' + index % 26;
+            index /= 26;
+        }
+        words[i][len] = '\0';
+    }
+    return words;
+}
+
+void word_keys_free(char **words, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++) {
+        free(words[i]);
+    }
+    free(words);
+}
+
+struct word_zipf *word_zipf_new(size_t n, double s) {
+    struct word_zipf *zipf = malloc(sizeof(*zipf) + n * sizeof(double));
+    double sum = 0;
+    size_t i;
+
+    if (zipf == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    zipf->n = n;
+    for (i = 0; i < n; i++) {
+        sum += 1 / pow(i + 1, s);
+        zipf->cdf[i] = sum;
+    }
+    return zipf;
+}
+
+size_t word_zipf_draw(const struct word_zipf *zipf, struct word_rng *rng) {
+    /* Binary search for the first rank whose cdf reaches u. */
+    double u = (word_rng_next(rng) >> 11) * 0x1p-53 * zipf->cdf[zipf->n - 1];
+    size_t lo = 0, hi = zipf->n - 1;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (zipf->cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void word_zipf_free(struct word_zipf *zipf) {
+    free(zipf);
+}
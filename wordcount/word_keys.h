@@ -0,0 +1,39 @@
+/*
+ * The word_keys interface generates the seeded synthetic words and key
+ * distributions the benchmarks count.
+ */
+
+#ifndef WORD_KEYS_H
+#define WORD_KEYS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* xorshift64* generator; any seed works. */
+struct word_rng {
+    uint64_t state;
+};
+
+void word_rng_seed(struct word_rng *rng, uint64_t seed);
+uint64_t word_rng_next(struct word_rng *rng);
+
+/* Returns a uniform random number in [0, N). */
+size_t word_rng_below(struct word_rng *rng, size_t n);
+
+/*
+ * Returns N distinct lowercase words of MIN_LEN to MAX_LEN bytes: random
+ * letters followed by the word's index in base 26. Exits if out of memory.
+ */
+char **word_keys_make(struct word_rng *rng, size_t n, size_t min_len,
+                      size_t max_len);
+
+void word_keys_free(char **words, size_t n);
+
+/* Zipf distribution of ranks [0, N): rank i has weight 1 / (i + 1)^S. */
+struct word_zipf;
+
+struct word_zipf *word_zipf_new(size_t n, double s);
+size_t word_zipf_draw(const struct word_zipf *zipf, struct word_rng *rng);
+void word_zipf_free(struct word_zipf *zipf);
+
+#endif /* WORD_KEYS_H */
@@ -0,0 +1,218 @@
+/*
+ * Implementation of the word_mem interface.
+ */
+
+#define _GNU_SOURCE
+
+#include "word_mem.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+bool word_mem_huge = false;
+struct word_mem_usage word_mem_usage[NUM_MEM_KINDS + 1];
+__thread long long word_mem_local[NUM_MEM_KINDS];
+
+static pthread_mutex_t usage_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *const kind_names[NUM_MEM_KINDS + 1] = {
+    "strings", "nodes", "buckets", "io", "total"};
+
+/* Set once a MAP_HUGETLB mapping fails: no 2 MB pages are reserved. */
+static bool hugetlb_failed;
+
+/* Mappings made each way, and their bytes, over the whole run. */
+static size_t hugetlb_maps, hugetlb_bytes;
+static size_t advised_maps, advised_bytes;
+
+static void usage_add(struct word_mem_usage *u, long long bytes) {
+    u->now += bytes;
+    if (u->now > u->peak) {
+        u->peak = u->now;
+    }
+}
+
+void word_mem_flush(void) {
+    long long total = 0;
+    int i;
+
+    pthread_mutex_lock(&usage_lock);
+    for (i = 0; i < NUM_MEM_KINDS; i++) {
+        usage_add(&word_mem_usage[i], word_mem_local[i]);
+        total += word_mem_local[i];
+        word_mem_local[i] = 0;
+    }
+    usage_add(&word_mem_usage[NUM_MEM_KINDS], total);
+    pthread_mutex_unlock(&usage_lock);
+}
+
+void word_mem_enable_huge(void) {
+    word_mem_huge = true;
+}
+
+/* Blocks of SIZE bytes get a mapping of their own. */
+static inline bool is_mapped(size_t size) {
+    return word_mem_huge && size >= WORD_MEM_HUGE_MIN;
+}
+
+static inline size_t map_len(size_t size) {
+    return (size + WORD_MEM_HUGE_PAGE - 1) & ~(size_t) (WORD_MEM_HUGE_PAGE - 1);
+}
+
+/*
+ * Maps SIZE zeroed bytes, from reserved huge pages if possible and otherwise
+ * from anonymous memory aligned to a huge page, so that transparent huge
+ * pages can back all of it.
+ */
+static void *map_block(size_t size) {
+    size_t len = map_len(size);
+    uintptr_t start, aligned;
+    void *p;
+
+    if (!__atomic_load_n(&hugetlb_failed, __ATOMIC_RELAXED)) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1,
+                 0);
+        if (p != MAP_FAILED) {
+            __atomic_fetch_add(&hugetlb_maps, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&hugetlb_bytes, len, __ATOMIC_RELAXED);
+            return p;
+        }
+        __atomic_store_n(&hugetlb_failed, true, __ATOMIC_RELAXED);
+    }
+
+    /* Map a huge page extra and trim both ends to align the block. */
+    p = mmap(NULL, len + WORD_MEM_HUGE_PAGE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+    start = (uintptr_t) p;
+    aligned = (start + WORD_MEM_HUGE_PAGE - 1) &
+              ~(uintptr_t) (WORD_MEM_HUGE_PAGE - 1);
+    if (aligned > start) {
+        munmap(p, aligned - start);
+    }
+    munmap((void *) (aligned + len), start + WORD_MEM_HUGE_PAGE - aligned);
+    p = (void *) aligned;
+    if (madvise(p, len, MADV_HUGEPAGE) == 0) {
+        __atomic_fetch_add(&advised_maps, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&advised_bytes, len, __ATOMIC_RELAXED);
+    }
+    return p;
+}
+
+void *word_mem_alloc(size_t size) {
+    void *p;
+    if (is_mapped(size)) {
+        return map_block(size);
+    }
+    if ((p = calloc(1, size)) == NULL) {
+        perror("calloc");
+    }
+    return p;
+}
+
+void *word_mem_realloc(void *p, size_t old_size, size_t size) {
+    void *q;
+
+    if (!is_mapped(size) && (p == NULL || !is_mapped(old_size))) {
+        if ((q = realloc(p, size)) == NULL) {
+            perror("realloc");
+        }
+        return q;
+    }
+    if (p != NULL && is_mapped(old_size) && map_len(size) <= map_len(old_size)) {
+        return p;
+    }
+    if (is_mapped(size)) {
+        q = map_block(size);
+    } else if ((q = malloc(size)) == NULL) {
+        perror("malloc");
+    }
+    if (q != NULL && p != NULL) {
+        memcpy(q, p, old_size < size ? old_size : size);
+        word_mem_free(p, old_size);
+    }
+    return q;
+}
+
+void word_mem_free(void *p, size_t size) {
+    if (p == NULL) {
+        return;
+    }
+    if (is_mapped(size)) {
+        munmap(p, map_len(size));
+    } else {
+        free(p);
+    }
+}
+
+void word_mem_advise_input(int fd) {
+    if (!word_mem_huge) {
+        return;
+    }
+    /* Pipes and terminals refuse advice, which is fine. */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+}
+
+/* Returns the process's memory backed by transparent huge pages, or -1. */
+static long long thp_backed_bytes(void) {
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    long long kb = -1;
+
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "AnonHugePages: %lld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb < 0 ? -1 : kb * 1024;
+}
+
+void word_mem_print(FILE *outfile) {
+    long long thp;
+
+    if (!word_mem_huge) {
+        return;
+    }
+    thp = thp_backed_bytes();
+    fprintf(outfile, "huge pages:   %zu MiB hugetlb in %zu maps, %zu MiB "
+                     "madvised in %zu maps",
+            hugetlb_bytes >> 20, hugetlb_maps, advised_bytes >> 20,
+            advised_maps);
+    if (thp >= 0) {
+        fprintf(outfile, " (%lld MiB THP-backed now)\n", thp >> 20);
+    } else {
+        fprintf(outfile, "\n");
+    }
+}
+
+void word_mem_print_usage(FILE *outfile) {
+    int i;
+
+    word_mem_flush();
+    pthread_mutex_lock(&usage_lock);
+    fprintf(outfile, "%-10s %12s %12s\n", "memory", "final(KiB)",
+            "peak(KiB)");
+    for (i = 0; i <= NUM_MEM_KINDS; i++) {
+        fprintf(outfile, "%-10s %12.1f %12.1f\n", kind_names[i],
+                word_mem_usage[i].now / 1024.0,
+                word_mem_usage[i].peak / 1024.0);
+    }
+    pthread_mutex_unlock(&usage_lock);
+}
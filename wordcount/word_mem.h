@@ -0,0 +1,96 @@
+/*
+ * The word_mem interface allocates the large arrays of the word count
+ * tables, hints the kernel about how inputs are read, and accounts for the
+ * memory each kind of structure holds.
+ *
+ * Off by default, every call maps straight onto malloc/realloc/free. With
+ * --hugepages, blocks of WORD_MEM_HUGE_MIN bytes or more are mapped on their
+ * own, from reserved 2 MB pages (MAP_HUGETLB) when the system has any and
+ * otherwise as 2 MB-aligned anonymous memory marked MADV_HUGEPAGE, so
+ * lookups that stride across a big table take fewer dTLB misses. Input
+ * files are then also advised as read sequentially and soon.
+ */
+
+#ifndef WORD_MEM_H
+#define WORD_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * What accounted memory holds. Every frontend keeps this accounting, and
+ * --stats reports it. Each thread adds to counters of its own and folds them
+ * into the shared usage, under a lock, once one of them has drifted by
+ * WORD_MEM_FOLD bytes and when the thread flushes its stats, so peaks are
+ * exact to within WORD_MEM_FOLD bytes per kind and thread.
+ */
+enum word_mem_kind {
+    MEM_STRINGS, /* Words kept outside entries: long keys, string pools. */
+    MEM_NODES,   /* Entries: list nodes, tree nodes and leaves, entry arrays. */
+    MEM_BUCKETS, /* Indexes over entries: hash slots, sort orders. */
+    MEM_IO,      /* Input buffers, chunks and batches in flight, scratch. */
+    NUM_MEM_KINDS
+};
+
+#define WORD_MEM_FOLD (16 * 1024)
+
+struct word_mem_usage {
+    long long now;  /* Bytes held. */
+    long long peak; /* Most bytes ever held at once. */
+};
+
+/*
+ * Usage of each kind, and of all of them together at [NUM_MEM_KINDS], as of
+ * the last fold of every thread.
+ */
+extern struct word_mem_usage word_mem_usage[NUM_MEM_KINDS + 1];
+
+/* Bytes of each kind this thread has accounted for but not yet folded. */
+extern __thread long long word_mem_local[NUM_MEM_KINDS];
+
+/* Folds this thread's counters into word_mem_usage. */
+void word_mem_flush(void);
+
+/* Records BYTES of KIND allocated, or freed if BYTES is negative. */
+static inline void word_mem_account(enum word_mem_kind kind, long long bytes) {
+    long long local = word_mem_local[kind] += bytes;
+    if (local >= WORD_MEM_FOLD || local <= -WORD_MEM_FOLD) {
+        word_mem_flush();
+    }
+}
+
+/* Size of a huge page, and the smallest block worth one. */
+#define WORD_MEM_HUGE_PAGE (2 * 1024 * 1024)
+#define WORD_MEM_HUGE_MIN WORD_MEM_HUGE_PAGE
+
+extern bool word_mem_huge;
+
+/* Turns on huge pages and input hints (--hugepages). */
+void word_mem_enable_huge(void);
+
+/* Returns SIZE zeroed bytes, or NULL (after perror) if out of memory. */
+void *word_mem_alloc(size_t size);
+
+/*
+ * Resizes block P of OLD_SIZE bytes, which may be NULL, to SIZE bytes,
+ * keeping its contents. Returns NULL, leaving P alone, if out of memory.
+ */
+void *word_mem_realloc(void *p, size_t old_size, size_t size);
+
+/* Frees block P of SIZE bytes, which must be the size it was given. */
+void word_mem_free(void *p, size_t size);
+
+/* Advises the kernel that FD will be read once, front to back, soon. */
+void word_mem_advise_input(int fd);
+
+/* Prints how much of the mapped memory got huge pages. */
+void word_mem_print(FILE *outfile);
+
+/*
+ * Prints final and peak usage of each kind of memory. The table's bytes per
+ * unique word are printed with the rest of --stats, from bytes_words.
+ */
+void word_mem_print_usage(FILE *outfile);
+
+#endif /* WORD_MEM_H */
@@ -0,0 +1,119 @@
+/*
+ * Implementation of the word_numa interface.
+ */
+
+#define _GNU_SOURCE
+
+#include "word_numa.h"
+
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct word_numa {
+    int nnodes;
+    cpu_set_t cpus[WORD_NUMA_MAX_NODES]; /* Allowed CPUs of each node. */
+    int ncpus[WORD_NUMA_MAX_NODES];
+    unsigned next[WORD_NUMA_MAX_NODES];  /* Next CPU to hand out, per node. */
+};
+
+/*
+ * Reads the CPU list of node NODE, like "0-3,8-11", into SET. Returns false
+ * if the node does not exist.
+ */
+static bool read_cpulist(int node, cpu_set_t *set) {
+    char path[64];
+    FILE *f;
+    int lo, hi, cpu;
+    char sep;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+             node);
+    if ((f = fopen(path, "r")) == NULL) {
+        return false;
+    }
+    CPU_ZERO(set);
+    while (fscanf(f, "%d", &lo) == 1) {
+        hi = lo;
+        if ((sep = fgetc(f)) == '-') {
+            if (fscanf(f, "%d", &hi) != 1) {
+                break;
+            }
+            sep = fgetc(f);
+        }
+        for (cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (sep != ',') {
+            break;
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+int word_numa_cpus(void) {
+    cpu_set_t allowed;
+    int cpus;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+        (cpus = CPU_COUNT(&allowed)) < 1) {
+        return 1;
+    }
+    return cpus;
+}
+
+struct word_numa *word_numa_detect(void) {
+    struct word_numa *numa;
+    cpu_set_t allowed;
+    int node;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 ||
+        (numa = calloc(1, sizeof(*numa))) == NULL) {
+        return NULL;
+    }
+    for (node = 0; node < WORD_NUMA_MAX_NODES; node++) {
+        cpu_set_t *set = &numa->cpus[numa->nnodes];
+        if (!read_cpulist(node, set)) {
+            continue;
+        }
+        CPU_AND(set, set, &allowed);
+        if ((numa->ncpus[numa->nnodes] = CPU_COUNT(set)) > 0) {
+            numa->nnodes++;
+        }
+    }
+    if (numa->nnodes < 2) {
+        free(numa);
+        return NULL;
+    }
+    return numa;
+}
+
+int word_numa_nodes(const struct word_numa *numa) {
+    return numa->nnodes;
+}
+
+int word_numa_place(struct word_numa *numa, int worker) {
+    int node = worker % numa->nnodes;
+    unsigned k = __atomic_fetch_add(&numa->next[node], 1, __ATOMIC_RELAXED) %
+                 numa->ncpus[node];
+    cpu_set_t one;
+    int cpu;
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &numa->cpus[node]) && k-- == 0) {
+            break;
+        }
+    }
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    if (sched_setaffinity(0, sizeof(one), &one) != 0) {
+        perror("sched_setaffinity");
+    }
+    return node;
+}
+
+void word_numa_free(struct word_numa *numa) {
+    free(numa);
+}
@@ -0,0 +1,37 @@
+/*
+ * The word_numa interface places worker threads on the NUMA nodes of the
+ * machine, so that each worker fills a table in its own node's memory.
+ *
+ * The topology comes from /sys/devices/system/node, restricted to the CPUs
+ * in the process's affinity mask; no libnuma is needed. Memory is placed by
+ * first touch: a worker pinned to a node allocates its table from that
+ * node's memory. On a machine with fewer than two usable nodes there is
+ * nothing to place, and word_numa_detect returns NULL.
+ */
+
+#ifndef WORD_NUMA_H
+#define WORD_NUMA_H
+
+#define WORD_NUMA_MAX_NODES 64
+
+struct word_numa;
+
+/* Returns the usable nodes, or NULL if there are fewer than two. */
+struct word_numa *word_numa_detect(void);
+
+/* Returns the number of CPUs in the process's affinity mask, at least 1. */
+int word_numa_cpus(void);
+
+/* Returns the number of usable nodes. */
+int word_numa_nodes(const struct word_numa *numa);
+
+/*
+ * Pins the calling thread, worker number WORKER, to one allowed CPU of a
+ * node, spreading workers round-robin over nodes and over each node's CPUs.
+ * Returns the node's number in [0, word_numa_nodes()).
+ */
+int word_numa_place(struct word_numa *numa, int worker);
+
+void word_numa_free(struct word_numa *numa);
+
+#endif /* WORD_NUMA_H */
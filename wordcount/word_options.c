@@ -0,0 +1,218 @@
+/*
+ * Implementation of the word_options interface.
+ */
+
+#include "word_options.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "word_helpers.h"
+#include "word_hll.h"
+#include "word_io.h"
+#include "word_mem.h"
+#include "word_progress.h"
+#include "word_stats.h"
+#include "word_trace.h"
+
+enum {
+    OPT_STATS = 256,
+    OPT_LOCK_STATS,
+    OPT_PREFIX,
+    OPT_UTF8,
+    OPT_AIO,
+    OPT_PIPELINE,
+    OPT_HUGEPAGES,
+    OPT_NUMA,
+    OPT_IO,
+    OPT_DISTINCT,
+    OPT_PROGRESS,
+    OPT_SNAPSHOT,
+    OPT_TRACE,
+    OPT_PERF,
+    OPT_BACKEND,
+};
+
+const char *word_options_prefix = NULL;
+const char *word_options_backend = NULL;
+int word_options_aio = -1;
+struct word_pipeline_config word_options_pipeline;
+bool word_options_numa = false;
+
+static const struct option long_options[] = {
+    {"stats", no_argument, NULL, OPT_STATS},
+    {"lock-stats", no_argument, NULL, OPT_LOCK_STATS},
+    {"prefix", required_argument, NULL, OPT_PREFIX},
+    {"utf8", no_argument, NULL, OPT_UTF8},
+    {"aio", optional_argument, NULL, OPT_AIO},
+    {"pipeline", optional_argument, NULL, OPT_PIPELINE},
+    {"hugepages", no_argument, NULL, OPT_HUGEPAGES},
+    {"numa", no_argument, NULL, OPT_NUMA},
+    {"io", required_argument, NULL, OPT_IO},
+    {"distinct", no_argument, NULL, OPT_DISTINCT},
+    {"progress", optional_argument, NULL, OPT_PROGRESS},
+    {"snapshot", required_argument, NULL, OPT_SNAPSHOT},
+    {"trace", required_argument, NULL, OPT_TRACE},
+    {"perf", no_argument, NULL, OPT_PERF},
+    {"backend", required_argument, NULL, OPT_BACKEND},
+    {NULL, 0, NULL, 0},
+};
+
+/*
+ * Parses all of ARG as a decimal number into *VALUE. Returns false if ARG is
+ * empty, has anything after the number or is out of range.
+ */
+static bool parse_long(const char *arg, long *value) {
+    char *end;
+    errno = 0;
+    *value = strtol(arg, &end, 10);
+    return end != arg && *end == '\0' && errno == 0;
+}
+
+/*
+ * Parses the --pipeline argument ARG, or picks word_pipeline_default's
+ * threads if there is none. Returns false if ARG is invalid.
+ */
+static bool parse_pipeline(const char *arg, struct word_pipeline_config *c) {
+    char end;
+    if (arg == NULL) {
+        word_pipeline_default(c);
+        return true;
+    }
+    return sscanf(arg, "%d,%d,%d%c", &c->readers, &c->tokenizers,
+                  &c->aggregators, &end) == 3 &&
+           c->readers > 0 && c->tokenizers > 0 && c->aggregators > 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [--stats] [--perf] [--lock-stats] [--prefix=PFX] "
+            "[--utf8] [--aio[=WORKERS]]\n"
+            "       [--pipeline[=READERS,TOKENIZERS,AGGREGATORS]] [--hugepages] "
+            "[--numa]\n"
+            "       [--io=stdio|read|mmap|direct[:BLOCK]] [--distinct]\n"
+            "       [--progress[=SECONDS]] [--snapshot=FILE] [--trace=FILE] "
+            "[--backend=NAME]\n"
+            "       [-n N] [FILE]...\n",
+            prog);
+}
+
+int word_options_parse(int argc, char *argv[]) {
+    int opt;
+
+    /* "+" stops at the first file name, like the frontends always have. */
+    while ((opt = getopt_long(argc, argv, "+n:", long_options, NULL)) != -1) {
+        switch (opt) {
+        case OPT_STATS:
+            word_stats_enable();
+            break;
+        case OPT_PERF:
+            /* Counters are reported with the rest of --stats. */
+            word_stats_enable();
+            word_perf_enable();
+            break;
+        case OPT_LOCK_STATS:
+            word_lock_stats_enable();
+            break;
+        case OPT_PREFIX:
+            word_options_prefix = optarg;
+            break;
+        case OPT_BACKEND:
+            word_options_backend = optarg;
+            break;
+        case OPT_UTF8:
+            count_words_mode = TOKENIZE_UTF8;
+            break;
+        case OPT_AIO: {
+            long workers = 0;
+            if ((optarg != NULL && !parse_long(optarg, &workers)) ||
+                workers < 0 || workers > INT_MAX) {
+                fprintf(stderr, "%s: --aio needs a worker count of 0 or more\n",
+                        argv[0]);
+                return -1;
+            }
+            word_options_aio = workers;
+            break;
+        }
+        case OPT_PIPELINE:
+            if (!parse_pipeline(optarg, &word_options_pipeline)) {
+                fprintf(stderr, "%s: --pipeline needs three thread counts "
+                                "above 0, like --pipeline=1,2,2\n",
+                        argv[0]);
+                return -1;
+            }
+            break;
+        case OPT_HUGEPAGES:
+            word_mem_enable_huge();
+            break;
+        case OPT_NUMA:
+            word_options_numa = true;
+            break;
+        case OPT_DISTINCT:
+            word_hll_enable();
+            break;
+        case OPT_PROGRESS: {
+            char *end = NULL;
+            word_progress_interval = optarg ? strtod(optarg, &end) : 1;
+            if ((optarg != NULL && (end == optarg || *end != '\0')) ||
+                !(word_progress_interval > 0) ||
+                !isfinite(word_progress_interval)) {
+                fprintf(stderr, "%s: --progress needs a number of seconds "
+                                "above 0\n",
+                        argv[0]);
+                return -1;
+            }
+            break;
+        }
+        case OPT_SNAPSHOT:
+            word_progress_snapshot_path = optarg;
+            break;
+        case OPT_TRACE:
+            word_trace_enable(optarg);
+            break;
+        case OPT_IO:
+            if (!word_io_parse(optarg)) {
+                fprintf(stderr, "%s: --io needs stdio, read, mmap or direct, "
+                                "optionally with :BLOCK, like --io=read:4M\n",
+                        argv[0]);
+                return -1;
+            }
+            break;
+        case 'n': {
+            long n;
+            if (!parse_long(optarg, &n) || n < 1 || n > NGRAM_MAX) {
+                fprintf(stderr, "%s: -n must be between 1 and %d\n", argv[0],
+                        NGRAM_MAX);
+                return -1;
+            }
+            count_words_ngram = n;
+            break;
+        }
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (word_options_aio >= 0 && word_options_pipeline.readers > 0) {
+        fprintf(stderr, "%s: --aio and --pipeline cannot be combined\n",
+                argv[0]);
+        return -1;
+    }
+    if (word_io_mode != WORD_IO_STDIO &&
+        (word_options_aio >= 0 || word_options_pipeline.readers > 0)) {
+        fprintf(stderr, "%s: --io cannot be combined with --aio or --pipeline, "
+                        "which do their own reading\n",
+                argv[0]);
+        return -1;
+    }
+    if (word_options_numa && word_options_pipeline.readers > 0) {
+        fprintf(stderr, "%s: --numa and --pipeline cannot be combined\n",
+                argv[0]);
+        return -1;
+    }
+    return optind;
+}
@@ -0,0 +1,49 @@
+/*
+ * The word_options interface parses the command line options shared by the
+ * word count frontends (words, lwords, pwords, fwords).
+ */
+
+#ifndef WORD_OPTIONS_H
+#define WORD_OPTIONS_H
+
+#include <stdbool.h>
+
+#include "word_pipeline.h"
+
+/* Set by --prefix=PFX: only report words starting with PFX. */
+extern const char *word_options_prefix;
+
+/*
+ * Set by --backend=NAME: the word_backend to count with (words, pwords and
+ * fwords only; "help" lists them). NULL when --backend is not given.
+ */
+extern const char *word_options_backend;
+
+/*
+ * Set by --aio[=WORKERS]: read files through word_aio. WORKERS is the number
+ * of tokenizing threads in pwords (0 means one per CPU); other frontends use
+ * one. -1 when --aio is not given.
+ */
+extern int word_options_aio;
+
+/*
+ * Set by --pipeline[=R,T,A]: count files with R reader, T tokenizer and A
+ * aggregator threads (pwords only). All zero when --pipeline is not given.
+ */
+extern struct word_pipeline_config word_options_pipeline;
+
+/*
+ * Set by --numa: pin workers to CPUs node by node and give each NUMA node
+ * its own table, merged at the end (pwords only). Has no effect on a
+ * single-node machine.
+ */
+extern bool word_options_numa;
+
+/*
+ * Parses leading options in ARGV, applying their settings. Returns the index
+ * of the first input file argument, or -1 after printing usage to stderr if
+ * the options are invalid.
+ */
+int word_options_parse(int argc, char *argv[]);
+
+#endif /* WORD_OPTIONS_H */
@@ -0,0 +1,261 @@
+/*
+ * Implementation of the word_perf interface.
+ */
+
+#define _GNU_SOURCE
+
+#include "word_perf.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} events[NUM_PERF_EVENTS] = {
+    [PERF_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    [PERF_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+                           "instructions"},
+    [PERF_LLC_MISSES] = {PERF_TYPE_HW_CACHE,
+                         PERF_COUNT_HW_CACHE_LL |
+                             PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                             PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+                         "LLC misses"},
+    [PERF_DTLB_MISSES] = {PERF_TYPE_HW_CACHE,
+                          PERF_COUNT_HW_CACHE_DTLB |
+                              PERF_COUNT_HW_CACHE_OP_READ << 8 |
+                              PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+                          "dTLB misses"},
+    [PERF_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+                            "branch misses"},
+};
+
+bool word_perf_enabled = false;
+
+/* Events that opened on the thread that enabled --perf. */
+static bool available[NUM_PERF_EVENTS];
+
+/*
+ * Set once a read finds the counters ran, and once one finds they ran for
+ * only part of the time they were enabled, sharing the PMU with other events.
+ */
+static bool scheduled, multiplexed;
+
+/* A thread's counter group. The cycles counter leads it. */
+struct perf_group {
+    int fds[NUM_PERF_EVENTS];
+    int slot[NUM_PERF_EVENTS]; /* Position in a group read, or -1. */
+    int nopen;
+};
+
+static __thread struct perf_group *group;
+static pthread_key_t group_key;
+static pthread_once_t group_once = PTHREAD_ONCE_INIT;
+
+static int open_event(int e, int leader) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[e].type;
+    attr.config = events[e].config;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, leader,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+static void close_group(void *arg) {
+    struct perf_group *g = arg;
+    int e;
+
+    for (e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (g->fds[e] >= 0) {
+            close(g->fds[e]);
+        }
+    }
+    free(g);
+}
+
+/* A child made by fork inherits counters that count its parent. */
+static void forget_group(void) {
+    if (group != NULL) {
+        close_group(group);
+        group = NULL;
+        pthread_setspecific(group_key, NULL);
+    }
+}
+
+static void make_key(void) {
+    pthread_key_create(&group_key, close_group);
+    pthread_atfork(NULL, NULL, forget_group);
+}
+
+/* Opens the calling thread's group. Returns NULL if cycles cannot be. */
+static struct perf_group *open_group(void) {
+    struct perf_group *g;
+    int e;
+
+    pthread_once(&group_once, make_key);
+    if ((g = malloc(sizeof(*g))) == NULL) {
+        return NULL;
+    }
+    g->nopen = 0;
+    for (e = 0; e < NUM_PERF_EVENTS; e++) {
+        g->fds[e] = -1;
+        g->slot[e] = -1;
+        if (e != PERF_CYCLES && !available[e]) {
+            continue;
+        }
+        g->fds[e] = open_event(e, e == PERF_CYCLES ? -1 : g->fds[PERF_CYCLES]);
+        if (g->fds[e] >= 0) {
+            g->slot[e] = g->nopen++;
+        } else if (e == PERF_CYCLES) {
+            free(g);
+            return NULL;
+        }
+    }
+    pthread_setspecific(group_key, g);
+    return g;
+}
+
+void word_perf_enable(void) {
+    int e, err, paranoid = -1;
+    FILE *f;
+
+    for (e = 0; e < NUM_PERF_EVENTS; e++) {
+        available[e] = true;
+    }
+    if ((group = open_group()) == NULL) {
+        err = errno;
+        if ((f = fopen("/proc/sys/kernel/perf_event_paranoid", "r")) != NULL) {
+            if (fscanf(f, "%d", &paranoid) != 1) {
+                paranoid = -1;
+            }
+            fclose(f);
+        }
+        fprintf(stderr, "perf: hardware counters unavailable (%s)",
+                strerror(err));
+        if ((err == EACCES || err == EPERM) && paranoid >= 0) {
+            fprintf(stderr, "; perf_event_paranoid is %d, 2 or less lets "
+                            "a process count itself",
+                    paranoid);
+        }
+        fprintf(stderr, "; going on without them\n");
+        return;
+    }
+    for (e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (group->slot[e] < 0) {
+            available[e] = false;
+            fprintf(stderr, "perf: no %s counter, leaving it out\n",
+                    events[e].name);
+        }
+    }
+    word_perf_enabled = true;
+}
+
+bool word_perf_read(uint64_t counts[NUM_PERF_EVENTS]) {
+    uint64_t buf[3 + NUM_PERF_EVENTS], enabled, running;
+    int e;
+
+    memset(counts, 0, NUM_PERF_EVENTS * sizeof(uint64_t));
+    if (group == NULL && (group = open_group()) == NULL) {
+        return false;
+    }
+    /*
+     * A group read is the number of counters, the time the group was enabled
+     * and the time it ran, and then the counters' values.
+     */
+    if (read(group->fds[PERF_CYCLES], buf, sizeof(buf)) <
+        (ssize_t) ((3 + group->nopen) * sizeof(uint64_t))) {
+        return false;
+    }
+    enabled = buf[1];
+    running = buf[2];
+    if (running == 0) {
+        /* Never on the PMU yet: nothing counted, and nothing to scale. */
+        return true;
+    }
+    if (!__atomic_load_n(&scheduled, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&scheduled, true, __ATOMIC_RELAXED);
+    }
+    if (running < enabled && !__atomic_load_n(&multiplexed, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&multiplexed, true, __ATOMIC_RELAXED);
+    }
+    /* Extrapolate counts of a multiplexed group to all the time enabled. */
+    for (e = 0; e < NUM_PERF_EVENTS; e++) {
+        if (group->slot[e] >= 0) {
+            counts[e] = running < enabled
+                            ? (uint64_t) ((double) buf[3 + group->slot[e]] *
+                                          enabled / running)
+                            : buf[3 + group->slot[e]];
+        }
+    }
+    return true;
+}
+
+/* Prints COUNT of event E per token, or "-" if it was not counted. */
+static void print_per_token(FILE *outfile, int e, uint64_t count,
+                            uint64_t tokens) {
+    if (available[e] && tokens != 0) {
+        fprintf(outfile, " %11.4f", (double) count / tokens);
+    } else {
+        fprintf(outfile, " %11s", "-");
+    }
+}
+
+static void print_row(FILE *outfile, const char *name,
+                      const uint64_t counts[NUM_PERF_EVENTS], uint64_t tokens) {
+    fprintf(outfile, "%-10s %11.3f", name, counts[PERF_CYCLES] / 1e6);
+    if (available[PERF_INSTRUCTIONS]) {
+        fprintf(outfile, " %11.3f %6.2f", counts[PERF_INSTRUCTIONS] / 1e6,
+                counts[PERF_CYCLES]
+                    ? (double) counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES]
+                    : 0.0);
+    } else {
+        fprintf(outfile, " %11s %6s", "-", "-");
+    }
+    print_per_token(outfile, PERF_LLC_MISSES, counts[PERF_LLC_MISSES], tokens);
+    print_per_token(outfile, PERF_DTLB_MISSES, counts[PERF_DTLB_MISSES],
+                    tokens);
+    print_per_token(outfile, PERF_BRANCH_MISSES, counts[PERF_BRANCH_MISSES],
+                    tokens);
+    fprintf(outfile, "\n");
+}
+
+void word_perf_print(FILE *outfile, const uint64_t (*phases)[NUM_PERF_EVENTS],
+                     const char *const *names, int nphases, uint64_t tokens) {
+    uint64_t total[NUM_PERF_EVENTS] = {0};
+    int i, e;
+
+    if (!word_perf_enabled) {
+        return;
+    }
+    if (!scheduled) {
+        fprintf(outfile, "perf: counters enabled but not scheduled on the "
+                         "PMU, nothing counted\n");
+        return;
+    }
+    if (multiplexed) {
+        fprintf(outfile, "perf: counters shared the PMU with other events; "
+                         "counts are scaled to the time enabled\n");
+    }
+    fprintf(outfile, "%-10s %11s %11s %6s %11s %11s %11s\n", "perf",
+            "cycles(M)", "instr(M)", "IPC", "LLC/token", "dTLB/token",
+            "brmiss/tok");
+    for (i = 0; i < nphases; i++) {
+        print_row(outfile, names[i], phases[i], tokens);
+        for (e = 0; e < NUM_PERF_EVENTS; e++) {
+            total[e] += phases[i][e];
+        }
+    }
+    print_row(outfile, "total", total, tokens);
+}
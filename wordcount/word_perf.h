@@ -0,0 +1,51 @@
+/*
+ * The word_perf interface counts hardware events per phase with
+ * perf_event_open (--perf): cycles, instructions, last-level cache misses,
+ * data TLB misses and branch misses, so --stats can tell whether a phase is
+ * bound by memory or by mispredicted branches.
+ *
+ * Each thread opens its own group of counters, user space only, the first
+ * time it reads them, and closes it when it exits. A word_timer reads the
+ * group when it starts and stops, which is a system call each time, so
+ * --perf costs about a microsecond per timed block or batch on top of
+ * --stats. Where the counters are not available to the process (no PMU in a
+ * virtual machine, or perf_event_paranoid above 2), --perf says why once and
+ * the run goes on without them; events the CPU lacks are left out.
+ */
+
+#ifndef WORD_PERF_H
+#define WORD_PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum word_perf_event {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_BRANCH_MISSES,
+    NUM_PERF_EVENTS
+};
+
+extern bool word_perf_enabled;
+
+/* Opens the counters on the calling thread to check they work (--perf). */
+void word_perf_enable(void);
+
+/*
+ * Reads the calling thread's counters into COUNTS, scaled up by the time
+ * the group was enabled over the time it ran when the kernel multiplexed it.
+ * Returns false, leaving COUNTS zero, if they are not available.
+ */
+bool word_perf_read(uint64_t counts[NUM_PERF_EVENTS]);
+
+/*
+ * Prints a line per phase with the events counted in it, IPC and misses per
+ * token. PHASES[i][e] is the count of event e in phase i, NAMES[i] its name.
+ */
+void word_perf_print(FILE *outfile, const uint64_t (*phases)[NUM_PERF_EVENTS],
+                     const char *const *names, int nphases, uint64_t tokens);
+
+#endif /* WORD_PERF_H */
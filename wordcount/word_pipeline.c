@@ -0,0 +1,568 @@
+/*
+ * Implementation of the word_pipeline interface.
+ *
+ * Reader r hands each file it reads to tokenizer (file % tokenizers) through
+ * ring chunks[r][t], and tokenizer t sends each key to the aggregator owning
+ * its hash through ring batches[t][a]. A tokenizer takes one file at a time
+ * from whichever reader has one ready and follows it to its last chunk, so
+ * words and n-grams that straddle chunks come out as they would from
+ * count_words. Rings carry END after a thread's last item.
+ *
+ * A stream has a single reader, which cuts it into chunks that each end at a
+ * word boundary and deals them out to the tokenizers as if each were a file
+ * of its own. For n-grams, a chunk starts with a copy of the last n - 1 words
+ * before it, which complete the n-grams that straddle the cut without adding
+ * any of their own.
+ */
+
+#ifndef WORD_REGISTRY
+#error "WORD_REGISTRY must be #define'd when compiling word_pipeline.c"
+#endif
+
+#include "word_pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "word_hash.h"
+#include "word_helpers.h"
+#include "word_hll.h"
+#include "word_mem.h"
+#include "word_progress.h"
+#include "word_ring.h"
+#include "word_stats.h"
+#include "word_trace.h"
+
+#define CHUNK_SIZE (256 * 1024)
+#define CHUNK_RING 8 /* Chunks queued from one reader to one tokenizer. */
+#define BATCH_SIZE 512
+#define BATCH_BYTES (16 * BATCH_SIZE) /* Usual room for a batch's words. */
+#define BATCH_RING 16 /* Batches queued from one tokenizer to one aggregator. */
+
+static char end_of_stream;
+#define END ((void *) &end_of_stream)
+
+struct chunk {
+    size_t len;
+    size_t cap; /* Size of DATA. */
+    bool last;  /* The last chunk of its file. */
+    unsigned char data[]; /* CHUNK_SIZE bytes, or more for a stream. */
+};
+
+/* Tokens bound for one aggregator, with copies of their words in BYTES. */
+struct batch {
+    int n;
+    size_t used;
+    size_t cap; /* Size of BYTES. */
+    word_token_t tokens[BATCH_SIZE];
+    char bytes[];
+};
+
+struct pipeline {
+    const struct word_pipeline_config *config;
+    char **files;
+    int nfiles;
+    int fd; /* Stream to read instead of FILES, or -1. */
+    int next_file;
+    struct word_ring *chunks;  /* [reader][tokenizer] */
+    struct word_ring *batches; /* [tokenizer][aggregator] */
+    /* What each tokenizer, then each aggregator, sleeps on when idle. */
+    struct word_ring_bell *bells;
+    word_count_list_t *partitions;
+};
+
+struct stage {
+    struct pipeline *p;
+    int id;
+};
+
+/*
+ * Pops the next item from any of the N rings RINGS[0], RINGS[STRIDE], ...
+ * that has not ended yet, waiting if all are empty, and sets *FROM to the
+ * ring's number. Returns NULL once every ring has delivered END; ENDED marks
+ * and NENDED counts those that have. The rings share the bell their consumer
+ * sleeps on, so a push into any of them wakes it.
+ */
+static void *pop_any(struct word_ring *rings, int n, int stride, bool ended[],
+                     int *nended, int *from) {
+    struct word_ring_bell *bell = rings[0].nonempty;
+    unsigned spins = 0;
+    void *item;
+    int i;
+
+    while (*nended < n) {
+        for (i = 0; i < n; i++) {
+            if (ended[i] || !word_ring_try_pop(&rings[i * stride], &item)) {
+                continue;
+            }
+            if (item != END) {
+                *from = i;
+                return item;
+            }
+            ended[i] = true;
+            (*nended)++;
+        }
+        if (*nended < n && word_ring_wait(&spins)) {
+            unsigned seq = word_ring_bell_arm(bell);
+            bool empty = true;
+            for (i = 0; i < n; i++) {
+                empty &= ended[i] || word_ring_empty(&rings[i * stride]);
+            }
+            word_ring_bell_sleep(bell, seq, empty);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Reads from FD into C until it holds CAP bytes, and marks C last if the
+ * input ends first. Returns false on error.
+ */
+static bool read_chunk(int fd, struct chunk *c, size_t cap) {
+    struct word_timer t;
+    ssize_t n = 0;
+
+    word_timer_start(&t);
+    while (c->len < cap &&
+           ((n = read(fd, c->data + c->len, cap - c->len)) > 0 ||
+            (n < 0 && errno == EINTR))) {
+        if (n > 0) {
+            c->len += n;
+        }
+    }
+    c->last = c->len < cap;
+    word_timer_stop(&t, PHASE_READ);
+    return n >= 0;
+}
+
+static struct chunk *chunk_new(size_t cap) {
+    struct chunk *c = malloc(sizeof(*c) + cap);
+    if (c == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    word_mem_account(MEM_IO, sizeof(*c) + cap);
+    c->len = 0;
+    c->cap = cap;
+    return c;
+}
+
+static void chunk_free(struct chunk *c) {
+    word_mem_account(MEM_IO, -(long long) (sizeof(*c) + c->cap));
+    free(c);
+}
+
+static void *reader_main(void *arg) {
+    struct stage *s = arg;
+    struct pipeline *p = s->p;
+    int tokenizers = p->config->tokenizers;
+    struct word_ring *rings = &p->chunks[s->id * tokenizers];
+    int file, i;
+
+    word_trace_thread("reader %d", s->id);
+    while ((file = __atomic_fetch_add(&p->next_file, 1, __ATOMIC_RELAXED)) <
+           p->nfiles) {
+        uint64_t start = word_trace_begin();
+        int fd = open(p->files[file], O_RDONLY);
+        struct chunk *c;
+
+        word_trace_end("open", start);
+
+        if (fd < 0) {
+            fprintf(stderr, "open: %s: %s\n", p->files[file], strerror(errno));
+            continue;
+        }
+        word_mem_advise_input(fd);
+        do {
+            c = chunk_new(CHUNK_SIZE);
+            if (!read_chunk(fd, c, CHUNK_SIZE)) {
+                fprintf(stderr, "read: %s: %s\n", p->files[file],
+                        strerror(errno));
+                c->last = true;
+            }
+            word_ring_push(&rings[file % tokenizers], c);
+        } while (!c->last);
+        close(fd);
+    }
+    for (i = 0; i < tokenizers; i++) {
+        word_ring_push(&rings[i], END);
+    }
+    word_stats_flush();
+    return NULL;
+}
+
+/*
+ * Returns the last N words of the text CONTEXT[0, CONTEXT_LEN) followed by
+ * TEXT[0, LEN) in a malloc'd buffer, setting *OUT_LEN. Both parts start at
+ * a word boundary and end just past one.
+ */
+static unsigned char *tail_context(const unsigned char *context,
+                                   size_t context_len,
+                                   const unsigned char *text, size_t len,
+                                   int n, size_t *out_len) {
+    int found, more;
+    size_t start = word_tail_start(text, len, n, &found);
+    size_t old = found < n ? word_tail_start(context, context_len, n - found,
+                                             &more)
+                           : context_len;
+    unsigned char *tail;
+
+    *out_len = (context_len - old) + (len - start);
+    if ((tail = malloc(*out_len)) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    memcpy(tail, context + old, context_len - old);
+    memcpy(tail + (context_len - old), text + start, len - start);
+    return tail;
+}
+
+/*
+ * Reads the stream P->fd in chunks cut at word boundaries, sending each
+ * chunk, as a file of its own, to the next tokenizer in turn.
+ */
+static void *stream_reader_main(void *arg) {
+    struct stage *s = arg;
+    struct pipeline *p = s->p;
+    int tokenizers = p->config->tokenizers;
+    struct word_ring *rings = &p->chunks[s->id * tokenizers];
+    int context_words = count_words_ngram - 1;
+    unsigned char *context = NULL, *carry = NULL;
+    size_t context_len = 0, carry_len = 0;
+    size_t cap = CHUNK_SIZE;
+    bool done = false;
+    int next = 0, i;
+
+    word_trace_thread("reader %d", s->id);
+    while (!done) {
+        size_t head = context_len + carry_len, split;
+        struct chunk *c;
+
+        /* Leave room to read at least a chunk's worth past what is kept. */
+        while (cap < head + CHUNK_SIZE / 2) {
+            cap *= 2;
+        }
+        c = chunk_new(cap);
+        memcpy(c->data, context, context_len);
+        memcpy(c->data + context_len, carry, carry_len);
+        c->len = head;
+        if (!read_chunk(p->fd, c, cap)) {
+            perror("read");
+        }
+        done = c->last;
+
+        /* Cut after the last boundary; the word it splits goes on. */
+        split = done ? c->len
+                     : context_len + word_split_point(c->data + context_len,
+                                                      c->len - context_len);
+        free(carry);
+        carry_len = c->len - split;
+        if ((carry = malloc(carry_len + 1)) == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        memcpy(carry, c->data + split, carry_len);
+        if (split == context_len) {
+            /* Nothing new to tokenize yet, e.g. in the middle of a huge
+             * word: read on into a bigger chunk. */
+            chunk_free(c);
+            cap *= 2;
+            continue;
+        }
+        c->len = split;
+        c->last = true;
+
+        if (context_words > 0) {
+            size_t len;
+            unsigned char *tail =
+                tail_context(context, context_len, c->data + context_len,
+                             split - context_len, context_words, &len);
+            free(context);
+            context = tail;
+            context_len = len;
+        }
+        word_ring_push(&rings[next++ % tokenizers], c);
+    }
+    free(context);
+    free(carry);
+    for (i = 0; i < tokenizers; i++) {
+        word_ring_push(&rings[i], END);
+    }
+    word_stats_flush();
+    return NULL;
+}
+
+/* word_source over the chunks of one file, starting with a popped chunk. */
+struct chunk_source {
+    struct word_source src;
+    struct word_ring *ring;
+    struct chunk *next;    /* Chunk to return next, if already popped. */
+    struct chunk *current; /* Chunk last returned. */
+};
+
+static bool chunk_source_next(struct word_source *src,
+                              const unsigned char **buf, size_t *len) {
+    struct chunk_source *cs = (struct chunk_source *) src;
+
+    if (cs->current != NULL) {
+        bool last = cs->current->last;
+        chunk_free(cs->current);
+        cs->current = NULL;
+        if (last) {
+            return false;
+        }
+    }
+    if (cs->next != NULL) {
+        cs->current = cs->next;
+        cs->next = NULL;
+    } else {
+        cs->current = word_ring_pop(cs->ring);
+    }
+    *buf = cs->current->data;
+    *len = cs->current->len;
+    return true;
+}
+
+/* word_sink sorting keys into per-aggregator batches. */
+struct batch_sink {
+    struct word_sink sink;
+    struct word_ring *rings; /* This tokenizer's row of batches[][]. */
+    int aggregators;
+    struct batch **open;     /* Batch being filled for each aggregator. */
+};
+
+static bool batch_sink_add(struct word_sink *sink, const word_token_t *tok) {
+    struct batch_sink *bs = (struct batch_sink *) sink;
+    /* Map the top bits of the mixed hash onto [0, aggregators). */
+    int a = ((word_hash_mix(tok->hash) >> 32) * bs->aggregators) >> 32;
+    struct batch *b = bs->open[a];
+
+    if (word_hll_input != NULL) {
+        word_hll_add(word_hll_input, tok->hash);
+    }
+    if (b != NULL && b->used + tok->len + 1 > b->cap) {
+        word_ring_push(&bs->rings[a], b);
+        b = NULL;
+    }
+    if (b == NULL) {
+        size_t cap = tok->len + 1 > BATCH_BYTES ? tok->len + 1 : BATCH_BYTES;
+        if ((b = malloc(sizeof(*b) + cap)) == NULL) {
+            perror("malloc");
+            bs->open[a] = NULL;
+            return false;
+        }
+        word_mem_account(MEM_IO, sizeof(*b) + cap);
+        b->n = 0;
+        b->used = 0;
+        b->cap = cap;
+        bs->open[a] = b;
+    }
+    /* The tokenizer reuses TOK's buffer, so the batch keeps a copy. */
+    memcpy(b->bytes + b->used, tok->word, tok->len + 1);
+    b->tokens[b->n] = *tok;
+    b->tokens[b->n].word = b->bytes + b->used;
+    b->used += tok->len + 1;
+    if (++b->n == BATCH_SIZE) {
+        word_ring_push(&bs->rings[a], b);
+        bs->open[a] = NULL;
+    }
+    return true;
+}
+
+static void *tokenizer_main(void *arg) {
+    struct stage *s = arg;
+    struct pipeline *p = s->p;
+    int readers = p->config->readers;
+    int tokenizers = p->config->tokenizers;
+    int aggregators = p->config->aggregators;
+    struct batch *open[aggregators];
+    struct batch_sink bs = {{batch_sink_add},
+                            &p->batches[s->id * aggregators],
+                            aggregators,
+                            open};
+    bool ended[readers];
+    int nended = 0;
+    struct chunk *c;
+    int r, i;
+
+    word_trace_thread("tokenizer %d", s->id);
+    memset(open, 0, sizeof(open));
+    memset(ended, 0, sizeof(ended));
+    /* A tokenizer sees pieces of many inputs, so it keeps one sketch. */
+    if (word_hll_enabled) {
+        word_hll_begin_input();
+    }
+    while ((c = pop_any(&p->chunks[s->id], readers, tokenizers, ended,
+                        &nended, &r)) != NULL) {
+        /* The rest of this file comes from the same reader. */
+        struct chunk_source cs = {{chunk_source_next},
+                                  &p->chunks[r * tokenizers + s->id], c, NULL};
+        tokenize_source(&cs.src, &bs.sink);
+        /* Skip whatever tokenizing left unread, e.g. after an error. */
+        if (cs.next != NULL) {
+            cs.current = cs.next;
+        }
+        while (cs.current != NULL && !cs.current->last) {
+            chunk_free(cs.current);
+            cs.current = word_ring_pop(cs.ring);
+        }
+        if (cs.current != NULL) {
+            chunk_free(cs.current);
+        }
+    }
+    for (i = 0; i < aggregators; i++) {
+        if (open[i] != NULL) {
+            word_ring_push(&bs.rings[i], open[i]);
+        }
+        word_ring_push(&bs.rings[i], END);
+    }
+    if (word_hll_enabled) {
+        char name[32];
+        snprintf(name, sizeof(name), "tokenizer %d", s->id);
+        word_hll_end_input();
+        word_hll_print_worker(stderr, name);
+    }
+    return NULL;
+}
+
+static void *aggregator_main(void *arg) {
+    struct stage *s = arg;
+    struct pipeline *p = s->p;
+    int tokenizers = p->config->tokenizers;
+    int aggregators = p->config->aggregators;
+    word_count_list_t *part = &p->partitions[s->id];
+    bool ended[tokenizers];
+    int nended = 0;
+    struct batch *b;
+    struct word_timer t;
+    int from;
+
+    word_trace_thread("aggregator %d", s->id);
+    memset(ended, 0, sizeof(ended));
+    while ((b = pop_any(&p->batches[s->id], tokenizers, aggregators, ended,
+                        &nended, &from)) != NULL) {
+        word_timer_start(&t);
+        add_words_batch(part, b->tokens, b->n);
+        word_timer_stop(&t, PHASE_LOOKUP);
+        WORD_STATS_ADD(tokens, b->n);
+        word_progress_add(0, b->n);
+        word_mem_account(MEM_IO, -(long long) (sizeof(*b) + b->cap));
+        free(b);
+        word_progress_poll();
+    }
+    word_stats_flush();
+    return NULL;
+}
+
+/* Creates COUNT threads running FN, numbered from 0. */
+static void start_stage(struct pipeline *p, pthread_t threads[],
+                        struct stage stages[], int count, void *(*fn)(void *)) {
+    int i;
+    for (i = 0; i < count; i++) {
+        stages[i].p = p;
+        stages[i].id = i;
+        if (pthread_create(&threads[i], NULL, fn, &stages[i]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+}
+
+static bool init_rings(struct word_ring **rings, int count, size_t cap) {
+    int i;
+    if ((*rings = malloc(count * sizeof(struct word_ring))) == NULL) {
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        if (!word_ring_init(&(*rings)[i], cap)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Runs pipeline P, read by READER threads, into WCLIST. */
+static void run_pipeline(word_count_list_t *wclist, struct pipeline p,
+                         void *(*reader)(void *)) {
+    const struct word_pipeline_config *config = p.config;
+    int readers = config->readers;
+    int tokenizers = config->tokenizers;
+    int aggregators = config->aggregators;
+    int nthreads = readers + tokenizers + aggregators;
+    pthread_t threads[nthreads];
+    struct stage stages[nthreads];
+    int i;
+
+    if (!init_rings(&p.chunks, readers * tokenizers, CHUNK_RING) ||
+        !init_rings(&p.batches, tokenizers * aggregators, BATCH_RING) ||
+        (p.bells = malloc((tokenizers + aggregators) *
+                          sizeof(struct word_ring_bell))) == NULL ||
+        (p.partitions = malloc(aggregators * sizeof(word_count_list_t))) ==
+            NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    for (i = 0; i < tokenizers + aggregators; i++) {
+        word_ring_bell_init(&p.bells[i]);
+    }
+    for (i = 0; i < readers * tokenizers; i++) {
+        word_ring_set_bells(&p.chunks[i], &p.bells[i % tokenizers], NULL);
+    }
+    for (i = 0; i < tokenizers * aggregators; i++) {
+        word_ring_set_bells(&p.batches[i],
+                            &p.bells[tokenizers + i % aggregators], NULL);
+    }
+    for (i = 0; i < aggregators; i++) {
+        init_words(&p.partitions[i]);
+    }
+    word_progress_watch(p.partitions, aggregators);
+
+    /* Downstream stages first, so they are ready when data arrives. */
+    start_stage(&p, threads, stages, aggregators, aggregator_main);
+    start_stage(&p, threads + aggregators, stages + aggregators, tokenizers,
+                tokenizer_main);
+    start_stage(&p, threads + aggregators + tokenizers,
+                stages + aggregators + tokenizers, readers, reader);
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Partitions hold disjoint words, so lists can join them by splicing. */
+    for (i = 0; i < aggregators; i++) {
+        merge_words(wclist, &p.partitions[i], true);
+    }
+    word_progress_watch(wclist, 1);
+
+    for (i = 0; i < readers * tokenizers; i++) {
+        word_ring_destroy(&p.chunks[i]);
+    }
+    for (i = 0; i < tokenizers * aggregators; i++) {
+        word_ring_destroy(&p.batches[i]);
+    }
+    free(p.chunks);
+    free(p.batches);
+    free(p.bells);
+    free(p.partitions);
+}
+
+void count_files_pipeline(word_count_list_t *wclist, char *files[], int nfiles,
+                          const struct word_pipeline_config *config) {
+    struct pipeline p = {config, files, nfiles, -1, 0, NULL, NULL, NULL, NULL};
+    run_pipeline(wclist, p, reader_main);
+}
+
+void count_stream_pipeline(word_count_list_t *wclist, int fd,
+                           const struct word_pipeline_config *config) {
+    /* A stream is read in order, so only one reader can help. */
+    struct word_pipeline_config one = *config;
+    struct pipeline p = {&one, NULL, 0, fd, 0, NULL, NULL, NULL, NULL};
+
+    one.readers = 1;
+    word_mem_advise_input(fd);
+    run_pipeline(wclist, p, stream_reader_main);
+}
@@ -0,0 +1,53 @@
+/*
+ * The word_pipeline interface counts files with separate reader, tokenizer
+ * and aggregator stages.
+ *
+ * Readers read files in large chunks, tokenizers turn chunks into batches of
+ * hashed keys, and each aggregator owns the keys of one hash partition, so
+ * no two threads ever update the same entry. Stages are connected by
+ * word_ring queues, one per pair of threads, and the partitions are joined
+ * into the caller's list at the end.
+ */
+
+#ifndef WORD_PIPELINE_H
+#define WORD_PIPELINE_H
+
+#include "word_count.h"
+#include "word_numa.h"
+
+/* Number of threads in each stage. */
+struct word_pipeline_config {
+    int readers;
+    int tokenizers;
+    int aggregators;
+};
+
+/*
+ * Sets C to one reader, which mostly waits on I/O, and the CPUs the process
+ * may run on shared out between tokenizers and aggregators, at least one
+ * each. Tokenizing is the larger half of the work, so tokenizers get the odd
+ * CPU.
+ */
+static inline void word_pipeline_default(struct word_pipeline_config *c) {
+    int cpus = word_numa_cpus();
+    c->readers = 1;
+    c->tokenizers = cpus > 1 ? (cpus + 1) / 2 : 1;
+    c->aggregators = cpus > 1 ? cpus / 2 : 1;
+}
+
+/*
+ * Adds the words of the NFILES files in FILES to WCLIST, which must be
+ * empty. Files that cannot be read are reported on stderr and skipped.
+ */
+void count_files_pipeline(word_count_list_t *wclist, char *files[], int nfiles,
+                          const struct word_pipeline_config *config);
+
+/*
+ * Adds the words read from FD, such as a pipe on stdin, to WCLIST, which
+ * must be empty. One reader cuts the stream into chunks at word boundaries
+ * for CONFIG's tokenizers and aggregators; CONFIG's reader count is ignored.
+ */
+void count_stream_pipeline(word_count_list_t *wclist, int fd,
+                           const struct word_pipeline_config *config);
+
+#endif /* WORD_PIPELINE_H */
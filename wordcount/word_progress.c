@@ -0,0 +1,270 @@
+/*
+ * Implementation of the word_progress interface.
+ */
+
+#define _GNU_SOURCE
+
+#include "word_progress.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "word_stats.h"
+
+double word_progress_interval = 0;
+const char *word_progress_snapshot_path = NULL;
+struct word_progress_counters *word_progress = NULL;
+volatile sig_atomic_t word_progress_requested = 0;
+
+/* Size of all inputs, or 0 if any is not a regular file. */
+static uint64_t total_bytes;
+static uint64_t start_ns;
+
+static pthread_t reporter;
+static bool reporting, stopping;
+static pthread_mutex_t reporter_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reporter_wake;
+
+/* The lists a snapshot writes; watch_lock keeps them while it does. */
+static pthread_mutex_t watch_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *watched;
+static int nwatched;
+static size_t watched_size;
+
+/* Processes SIGUSR1 is passed on to, and this process's input if a child. */
+static const pid_t *forward_pids;
+static volatile sig_atomic_t nforward;
+static int child_index = -1;
+
+static void on_sigusr1(int sig) {
+    int saved = errno;
+    int i;
+
+    (void) sig;
+    if (nforward > 0) {
+        for (i = 0; i < nforward; i++) {
+            /* Never -1, a failed fork, which would signal everything. */
+            if (forward_pids[i] > 0) {
+                kill(forward_pids[i], SIGUSR1);
+            }
+        }
+    } else {
+        word_progress_requested = 1;
+    }
+    errno = saved;
+}
+
+/* Formats SECONDS as H:MM:SS, or M:SS under an hour. */
+static void format_duration(char *buf, size_t size, double seconds) {
+    long s = (long) (seconds + 0.5);
+    if (s >= 3600) {
+        snprintf(buf, size, "%ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+    } else {
+        snprintf(buf, size, "%ld:%02ld", s / 60, s % 60);
+    }
+}
+
+static void report(bool done) {
+    uint64_t bytes = __atomic_load_n(&word_progress->bytes, __ATOMIC_RELAXED);
+    uint64_t tokens = __atomic_load_n(&word_progress->tokens, __ATOMIC_RELAXED);
+    double elapsed = (word_now_ns() - start_ns) / 1e9;
+    double mib = bytes / 1048576.0, rate = elapsed > 0 ? bytes / elapsed : 0;
+    char eta[32];
+
+    if (done) {
+        fprintf(stderr, "progress: done, %.1f MiB and %.2f Mwords in %.2f s\n",
+                mib, tokens / 1e6, elapsed);
+        return;
+    }
+    if (total_bytes == 0) {
+        fprintf(stderr, "progress: %.1f MiB", mib);
+    } else {
+        fprintf(stderr, "progress: %.1f of %.1f MiB (%.1f%%)", mib,
+                total_bytes / 1048576.0, 100.0 * bytes / total_bytes);
+    }
+    fprintf(stderr, ", %.2f Mwords/s, %.1f MiB/s",
+            elapsed > 0 ? tokens / elapsed / 1e6 : 0.0, rate / 1048576.0);
+    if (total_bytes != 0 && rate > 0 && bytes <= total_bytes) {
+        format_duration(eta, sizeof(eta), (total_bytes - bytes) / rate);
+        fprintf(stderr, ", ETA %s", eta);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void *reporter_main(void *arg) {
+    struct timespec next;
+    uint64_t step = (uint64_t) (word_progress_interval * 1e9);
+
+    (void) arg;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&reporter_lock);
+    while (!stopping) {
+        uint64_t ns = next.tv_nsec + step;
+        next.tv_sec += ns / 1000000000;
+        next.tv_nsec = ns % 1000000000;
+        while (!stopping && pthread_cond_timedwait(&reporter_wake,
+                                                   &reporter_lock,
+                                                   &next) != ETIMEDOUT) {
+        }
+        if (!stopping) {
+            report(false);
+        }
+    }
+    pthread_mutex_unlock(&reporter_lock);
+    return NULL;
+}
+
+/* Returns the total size of the inputs, or 0 if it cannot be known. */
+static uint64_t input_size(char *files[], int nfiles) {
+    struct stat st;
+    uint64_t total = 0;
+    int i;
+
+    if (nfiles == 0) {
+        return fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)
+                   ? (uint64_t) st.st_size
+                   : 0;
+    }
+    for (i = 0; i < nfiles; i++) {
+        if (stat(files[i], &st) != 0 || !S_ISREG(st.st_mode)) {
+            return 0;
+        }
+        total += st.st_size;
+    }
+    return total;
+}
+
+void word_progress_begin(char *files[], int nfiles) {
+    struct sigaction sa;
+    pthread_condattr_t attr;
+
+    if (word_progress_snapshot_path != NULL) {
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sigusr1;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+    if (word_progress_interval <= 0) {
+        return;
+    }
+
+    /* Shared, so that children made by fork count toward the parent's. */
+    word_progress = mmap(NULL, sizeof(*word_progress), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (word_progress == MAP_FAILED) {
+        perror("mmap");
+        word_progress = NULL;
+        return;
+    }
+    total_bytes = input_size(files, nfiles);
+    start_ns = word_now_ns();
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&reporter_wake, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&reporter, NULL, reporter_main, NULL) != 0) {
+        perror("pthread_create");
+        return;
+    }
+    reporting = true;
+}
+
+void word_progress_watch_lists(void *lists, int n, size_t size) {
+    pthread_mutex_lock(&watch_lock);
+    watched = lists;
+    nwatched = n;
+    watched_size = size;
+    pthread_mutex_unlock(&watch_lock);
+}
+
+void word_progress_forward(const pid_t *pids, int n) {
+    nforward = 0;
+    forward_pids = pids;
+    nforward = n;
+}
+
+void word_progress_child(int index) {
+    nforward = 0;
+    child_index = index;
+}
+
+void word_progress_end(void) {
+    nforward = 0;
+    if (reporting) {
+        pthread_mutex_lock(&reporter_lock);
+        stopping = true;
+        pthread_cond_signal(&reporter_wake);
+        pthread_mutex_unlock(&reporter_lock);
+        pthread_join(reporter, NULL);
+        reporting = false;
+        report(true);
+    }
+    word_progress_poll();
+}
+
+void word_progress_snapshot(void) {
+    char path[PATH_MAX], tmp[PATH_MAX + 8];
+    char *buf = NULL;
+    size_t size = 0, words = 0;
+    uint64_t start, copy_ns;
+    FILE *mem, *out;
+    int i;
+
+    /* Only one of the threads that saw the request takes it. */
+    if (!__atomic_exchange_n(&word_progress_requested, 0, __ATOMIC_ACQ_REL) ||
+        word_progress_snapshot_path == NULL) {
+        return;
+    }
+    if (child_index >= 0) {
+        snprintf(path, sizeof(path), "%s.%d", word_progress_snapshot_path,
+                 child_index);
+    } else {
+        snprintf(path, sizeof(path), "%s", word_progress_snapshot_path);
+    }
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    /* Copy the counts into memory while the lists are held... */
+    start = word_now_ns();
+    if ((mem = open_memstream(&buf, &size)) == NULL) {
+        perror("open_memstream");
+        return;
+    }
+    pthread_mutex_lock(&watch_lock);
+    for (i = 0; i < nwatched; i++) {
+        word_count_list_t *wclist =
+            (word_count_list_t *) (watched + i * watched_size);
+        fprint_words(wclist, mem);
+        words += len_words(wclist);
+    }
+    pthread_mutex_unlock(&watch_lock);
+    fclose(mem);
+    copy_ns = word_now_ns() - start;
+
+    /* ...and write them out once the workers can go on. */
+    if ((out = fopen(tmp, "w")) == NULL) {
+        perror(tmp);
+        free(buf);
+        return;
+    }
+    if ((fwrite(buf, 1, size, out) != size) | (fclose(out) != 0)) {
+        perror(tmp);
+        unlink(tmp);
+    } else if (rename(tmp, path) != 0) {
+        perror(path);
+        unlink(tmp);
+    } else {
+        fprintf(stderr, "snapshot: %zu words to %s, copied in %.1f ms\n",
+                words, path, copy_ns / 1e6);
+    }
+    free(buf);
+}
@@ -0,0 +1,102 @@
+/*
+ * The word_progress interface reports on long runs while they count.
+ *
+ * With --progress[=SECONDS], a reporter thread prints the bytes read so far
+ * out of the inputs' total, the words counted per second and an estimate of
+ * the time left to stderr, every SECONDS (default 1). The counters are in
+ * shared memory, so in fwords the children's reading shows in the parent.
+ *
+ * With --snapshot=FILE, SIGUSR1 asks for the partial counts. The next
+ * counting thread to finish a block of input writes every watched list to
+ * FILE, unsorted, in the output format, and renames it into place so FILE is
+ * always complete. Workers wait only while the lists are copied: pwords
+ * prints each table under its lock into memory and writes it out after. The
+ * fwords parent forwards the signal to its children, which write FILE.N for
+ * their N-th input.
+ */
+
+#ifndef WORD_PROGRESS_H
+#define WORD_PROGRESS_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "word_count.h"
+
+struct word_progress_counters {
+    uint64_t bytes;  /* Input bytes tokenized. */
+    uint64_t tokens; /* Words added to the lists. */
+};
+
+/* Set by --progress: seconds between reports, or 0 for none. */
+extern double word_progress_interval;
+
+/* Set by --snapshot: where SIGUSR1 writes the partial counts, or NULL. */
+extern const char *word_progress_snapshot_path;
+
+/* Shared counters while --progress is on, otherwise NULL. */
+extern struct word_progress_counters *word_progress;
+
+/* Set by SIGUSR1 until a counting thread takes the snapshot. */
+extern volatile sig_atomic_t word_progress_requested;
+
+/*
+ * Starts reporting on a run over the NFILES files in FILES, or stdin if there
+ * are none, and installs the SIGUSR1 handler. Call before starting workers.
+ */
+void word_progress_begin(char *files[], int nfiles);
+
+/* word_progress_watch for lists SIZE bytes apart. */
+void word_progress_watch_lists(void *lists, int n, size_t size);
+
+/*
+ * Makes the N lists at LISTS the ones a snapshot writes. Waits for a
+ * snapshot in progress to finish first. Inline, because the size of a list
+ * depends on the backend the caller was built for.
+ */
+static inline void word_progress_watch(word_count_list_t *lists, int n) {
+    word_progress_watch_lists(lists, n, sizeof(*lists));
+}
+
+/* Forwards SIGUSR1 to the N processes in PIDS instead (fwords). */
+void word_progress_forward(const pid_t *pids, int n);
+
+/* In a child made by fork: snapshots go to FILE.INDEX. */
+void word_progress_child(int index);
+
+/*
+ * Stops the reporter, printing a last line, and takes any snapshot still
+ * asked for. Call once the workers are done.
+ */
+void word_progress_end(void);
+
+/* Writes the snapshot asked for; see word_progress_poll. */
+void word_progress_snapshot(void);
+
+/* Counts BYTES of input and TOKENS words toward the progress reports. */
+static inline void word_progress_add(uint64_t bytes, uint64_t tokens) {
+    if (word_progress == NULL) {
+        return;
+    }
+    if (bytes != 0) {
+        __atomic_fetch_add(&word_progress->bytes, bytes, __ATOMIC_RELAXED);
+    }
+    if (tokens != 0) {
+        __atomic_fetch_add(&word_progress->tokens, tokens, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Takes a snapshot if one was asked for. Counting threads call this between
+ * blocks, holding no list locks and with no list half updated.
+ */
+static inline void word_progress_poll(void) {
+    if (word_progress_requested) {
+        word_progress_snapshot();
+    }
+}
+
+#endif /* WORD_PROGRESS_H */
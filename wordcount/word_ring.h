@@ -0,0 +1,194 @@
+/*
+ * Bounded single-producer, single-consumer ring of pointers.
+ *
+ * The producer only writes tail and the consumer only writes head, each on
+ * its own cache line, so neither side takes a lock. A full or empty ring is
+ * waited out by spinning briefly, then yielding the CPU a few times, and then
+ * parking on a futex until the other side rings its bell.
+ *
+ * Each ring points at two bells: NONEMPTY, which its consumer sleeps on, and
+ * NONFULL, which its producer sleeps on. They default to bells of the ring's
+ * own; a consumer that waits on several rings at once points them all at one
+ * bell with word_ring_set_bells.
+ */
+
+#ifndef WORD_RING_H
+#define WORD_RING_H
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define WORD_RING_SPINS 64
+#define WORD_RING_YIELDS 16
+
+/* A futex the waiting side of rings sleeps on. */
+struct word_ring_bell {
+    unsigned seq;      /* Bumped each time it rings with sleepers. */
+    unsigned sleepers; /* Threads asleep on it, or about to be. */
+} __attribute__((aligned(64)));
+
+struct word_ring {
+    size_t head __attribute__((aligned(64))); /* Next slot to pop. */
+    size_t tail __attribute__((aligned(64))); /* Next slot to push. */
+    size_t mask __attribute__((aligned(64)));
+    void **slots;
+    struct word_ring_bell *nonempty; /* Rung after a push. */
+    struct word_ring_bell *nonfull;  /* Rung after a pop. */
+    struct word_ring_bell bells[2];  /* The defaults for the two above. */
+};
+
+static inline void word_ring_bell_init(struct word_ring_bell *bell) {
+    bell->seq = bell->sleepers = 0;
+}
+
+/*
+ * Wakes whoever sleeps on BELL. The fence orders the caller's push or pop
+ * before the load of sleepers, against word_ring_bell_arm's increment of
+ * sleepers before its caller looks at the ring again, so either the sleeper
+ * sees the change or this sees the sleeper.
+ */
+static inline void word_ring_bell_ring(struct word_ring_bell *bell) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&bell->sleepers, __ATOMIC_RELAXED) != 0) {
+        __atomic_fetch_add(&bell->seq, 1, __ATOMIC_SEQ_CST);
+        syscall(SYS_futex, &bell->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL,
+                NULL, 0);
+    }
+}
+
+/*
+ * Announces a sleeper on BELL. Returns the sequence number to pass to
+ * word_ring_bell_sleep once the caller has looked at its rings again.
+ */
+static inline unsigned word_ring_bell_arm(struct word_ring_bell *bell) {
+    unsigned seq = __atomic_load_n(&bell->seq, __ATOMIC_ACQUIRE);
+    __atomic_fetch_add(&bell->sleepers, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return seq;
+}
+
+/*
+ * Sleeps on BELL if SLEEP, until it rings after SEQ, and withdraws the
+ * sleeper word_ring_bell_arm announced either way.
+ */
+static inline void word_ring_bell_sleep(struct word_ring_bell *bell,
+                                        unsigned seq, bool sleep) {
+    if (sleep) {
+        syscall(SYS_futex, &bell->seq, FUTEX_WAIT_PRIVATE, seq, NULL, NULL,
+                0);
+    }
+    __atomic_fetch_sub(&bell->sleepers, 1, __ATOMIC_RELAXED);
+}
+
+/* Initializes RING with room for CAP pointers; CAP must be a power of two. */
+static inline bool word_ring_init(struct word_ring *ring, size_t cap) {
+    ring->head = ring->tail = 0;
+    ring->mask = cap - 1;
+    ring->slots = malloc(cap * sizeof(void *));
+    word_ring_bell_init(&ring->bells[0]);
+    word_ring_bell_init(&ring->bells[1]);
+    ring->nonempty = &ring->bells[0];
+    ring->nonfull = &ring->bells[1];
+    return ring->slots != NULL;
+}
+
+/*
+ * Makes RING's consumer sleep on NONEMPTY and its producer on NONFULL, either
+ * of which may be NULL to keep the ring's own. Before the ring is used.
+ */
+static inline void word_ring_set_bells(struct word_ring *ring,
+                                       struct word_ring_bell *nonempty,
+                                       struct word_ring_bell *nonfull) {
+    if (nonempty != NULL) {
+        ring->nonempty = nonempty;
+    }
+    if (nonfull != NULL) {
+        ring->nonfull = nonfull;
+    }
+}
+
+static inline void word_ring_destroy(struct word_ring *ring) {
+    free(ring->slots);
+}
+
+static inline bool word_ring_full(struct word_ring *ring) {
+    return ring->tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) >
+           ring->mask;
+}
+
+static inline bool word_ring_empty(struct word_ring *ring) {
+    return ring->head == __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+/* Pushes P unless the ring is full. Producer only. */
+static inline bool word_ring_try_push(struct word_ring *ring, void *p) {
+    size_t tail = ring->tail;
+    if (word_ring_full(ring)) {
+        return false;
+    }
+    ring->slots[tail & ring->mask] = p;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    word_ring_bell_ring(ring->nonempty);
+    return true;
+}
+
+/* Pops the oldest pointer into *P unless the ring is empty. Consumer only. */
+static inline bool word_ring_try_pop(struct word_ring *ring, void **p) {
+    size_t head = ring->head;
+    if (word_ring_empty(ring)) {
+        return false;
+    }
+    *p = ring->slots[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    word_ring_bell_ring(ring->nonfull);
+    return true;
+}
+
+/*
+ * Waits after a failed push or pop: spins at first, then yields. Returns true
+ * once both are used up and the caller should park on a bell instead.
+ */
+static inline bool word_ring_wait(unsigned *spins) {
+    if (++*spins < WORD_RING_SPINS) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+        return false;
+    } else if (*spins < WORD_RING_SPINS + WORD_RING_YIELDS) {
+        sched_yield();
+        return false;
+    }
+    return true;
+}
+
+/* Pushes P, waiting while the ring is full. */
+static inline void word_ring_push(struct word_ring *ring, void *p) {
+    unsigned spins = 0;
+    while (!word_ring_try_push(ring, p)) {
+        if (word_ring_wait(&spins)) {
+            unsigned seq = word_ring_bell_arm(ring->nonfull);
+            word_ring_bell_sleep(ring->nonfull, seq, word_ring_full(ring));
+        }
+    }
+}
+
+/* Pops the oldest pointer, waiting while the ring is empty. */
+static inline void *word_ring_pop(struct word_ring *ring) {
+    unsigned spins = 0;
+    void *p;
+    while (!word_ring_try_pop(ring, &p)) {
+        if (word_ring_wait(&spins)) {
+            unsigned seq = word_ring_bell_arm(ring->nonempty);
+            word_ring_bell_sleep(ring->nonempty, seq, word_ring_empty(ring));
+        }
+    }
+    return p;
+}
+
+#endif /* WORD_RING_H */
@@ -0,0 +1,271 @@
+/*
+ * Implementation of the word_stats interface.
+ */
+
+#include "word_stats.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "word_io.h"
+#include "word_mem.h"
+#include "word_trace.h"
+
+bool word_stats_enabled = false;
+__thread struct word_stats word_stats_local;
+
+static struct word_stats totals;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t start_ns;
+
+static const char *const phase_names[NUM_PHASES] = {
+    "read", "tokenize", "lookup", "merge", "sort", "output",
+};
+
+/* Span names of the phases; lookups happen a batch of inserts at a time. */
+static const char *span_names[NUM_PHASES] = {
+    "read", "tokenize", "insert batch", "merge", "sort", "output",
+};
+
+static uint64_t clock_ns(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+uint64_t word_now_ns(void) {
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+uint64_t word_thread_cpu_ns(void) {
+    return clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void word_stats_enable(void) {
+    word_stats_enabled = true;
+    start_ns = word_now_ns();
+}
+
+void word_timer_start(struct word_timer *t) {
+    /* Read the counters outside the clocks, to leave their cost out. */
+    if (word_perf_enabled) {
+        word_perf_read(t->perf);
+    }
+    if (word_stats_enabled) {
+        t->wall = word_now_ns();
+        t->cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    } else if (word_trace_enabled) {
+        t->wall = word_now_ns();
+    }
+}
+
+void word_timer_stop(struct word_timer *t, enum word_phase phase) {
+    uint64_t now;
+
+    if (!word_stats_enabled && !word_trace_enabled) {
+        return;
+    }
+    now = word_now_ns();
+    if (word_stats_enabled) {
+        word_stats_local.wall_ns[phase] += now - t->wall;
+        word_stats_local.cpu_ns[phase] +=
+            clock_ns(CLOCK_THREAD_CPUTIME_ID) - t->cpu;
+    }
+    if (word_trace_enabled) {
+        word_trace_record(span_names[phase], t->wall, now);
+    }
+    if (word_perf_enabled) {
+        word_perf_add(word_stats_local.perf[phase], t->perf);
+    }
+}
+
+void word_perf_add(uint64_t sum[NUM_PERF_EVENTS],
+                   const uint64_t start[NUM_PERF_EVENTS]) {
+    uint64_t now[NUM_PERF_EVENTS];
+    int e;
+
+    if (word_perf_read(now)) {
+        for (e = 0; e < NUM_PERF_EVENTS; e++) {
+            sum[e] += now[e] - start[e];
+        }
+    }
+}
+
+void word_stats_flush(void) {
+    struct word_stats *l = &word_stats_local;
+    int i, e;
+
+    if (!word_stats_enabled) {
+        return;
+    }
+    word_mem_flush();
+    pthread_mutex_lock(&totals_lock);
+    for (i = 0; i < NUM_PHASES; i++) {
+        totals.wall_ns[i] += l->wall_ns[i];
+        totals.cpu_ns[i] += l->cpu_ns[i];
+        for (e = 0; e < NUM_PERF_EVENTS; e++) {
+            totals.perf[i][e] += l->perf[i][e];
+        }
+    }
+    totals.bytes += l->bytes;
+    totals.tokens += l->tokens;
+    totals.short_tokens += l->short_tokens;
+    totals.lookups += l->lookups;
+    totals.compares += l->compares;
+    totals.inserts += l->inserts;
+    totals.allocs += l->allocs;
+    pthread_mutex_unlock(&totals_lock);
+    *l = (struct word_stats){0};
+}
+
+void word_stats_print(FILE *outfile, const char *label, size_t unique,
+                      size_t table_bytes) {
+    struct word_stats *s = &totals;
+    uint64_t elapsed;
+    int i;
+
+    if (!word_stats_enabled) {
+        return;
+    }
+    word_stats_flush();
+    elapsed = word_now_ns() - start_ns;
+
+    pthread_mutex_lock(&totals_lock);
+    fprintf(outfile, "--- %s stats ---\n", label);
+    fprintf(outfile, "%-10s %12s %12s\n", "phase", "wall(ms)", "cpu(ms)");
+    for (i = 0; i < NUM_PHASES; i++) {
+        fprintf(outfile, "%-10s %12.3f", phase_names[i],
+                s->wall_ns[i] / 1e6);
+        /* A phase no thread entered has no CPU time to show. */
+        if (s->cpu_ns[i] != 0) {
+            fprintf(outfile, " %12.3f\n", s->cpu_ns[i] / 1e6);
+        } else {
+            fprintf(outfile, " %12s\n", "-");
+        }
+    }
+    fprintf(outfile, "%-10s %12.3f\n", "elapsed", elapsed / 1e6);
+    fprintf(outfile, "bytes read:   %llu\n", (unsigned long long) s->bytes);
+    fprintf(outfile, "tokens:       %llu (%llu one-letter skipped)\n",
+            (unsigned long long) s->tokens,
+            (unsigned long long) s->short_tokens);
+    fprintf(outfile, "unique words: %zu\n", unique);
+    fprintf(outfile, "table bytes:  %zu (%.1f per unique word)\n", table_bytes,
+            unique ? (double) table_bytes / unique : 0.0);
+    fprintf(outfile, "lookups:      %llu (%.2f compares/lookup)\n",
+            (unsigned long long) s->lookups,
+            s->lookups ? (double) s->compares / s->lookups : 0.0);
+    fprintf(outfile, "inserts:      %llu\n", (unsigned long long) s->inserts);
+    fprintf(outfile, "allocations:  %llu\n", (unsigned long long) s->allocs);
+    word_perf_print(outfile, s->perf, phase_names, NUM_PHASES, s->tokens);
+    word_mem_print_usage(outfile);
+    word_io_print(outfile, s->bytes, s->wall_ns[PHASE_READ], elapsed);
+    word_mem_print(outfile);
+    pthread_mutex_unlock(&totals_lock);
+}
+
+/* Lock profile of one thread. Records live until exit so they can be
+ * reported after the workers are joined. */
+struct lock_thread {
+    int id;
+    uint64_t acquisitions;
+    uint64_t contended; /* Acquisitions where trylock failed. */
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+    uint64_t max_hold_ns;
+    uint64_t held_since;
+    struct lock_thread *next;
+};
+
+bool word_lock_stats_enabled = false;
+static __thread struct lock_thread *lock_self;
+static struct lock_thread *lock_threads;
+static struct lock_thread **lock_threads_tail = &lock_threads;
+static int lock_thread_count;
+
+void word_lock_stats_enable(void) {
+    word_lock_stats_enabled = true;
+}
+
+static struct lock_thread *lock_thread_self(void) {
+    if (lock_self == NULL) {
+        if ((lock_self = calloc(1, sizeof(*lock_self))) == NULL) {
+            perror("calloc");
+            exit(1);
+        }
+        pthread_mutex_lock(&totals_lock);
+        lock_self->id = lock_thread_count++;
+        *lock_threads_tail = lock_self;
+        lock_threads_tail = &lock_self->next;
+        pthread_mutex_unlock(&totals_lock);
+    }
+    return lock_self;
+}
+
+void word_mutex_lock_profiled(pthread_mutex_t *mutex) {
+    struct lock_thread *self;
+    uint64_t start = word_now_ns(), now;
+    bool contended = pthread_mutex_trylock(mutex) != 0;
+
+    if (contended) {
+        pthread_mutex_lock(mutex);
+    }
+    now = word_now_ns();
+    if (contended && word_trace_enabled) {
+        word_trace_record("lock wait", start, now);
+    }
+    if (!word_lock_stats_enabled) {
+        return;
+    }
+    self = lock_thread_self();
+    self->contended += contended;
+    self->held_since = now;
+    self->wait_ns += now - start;
+    self->acquisitions++;
+}
+
+void word_mutex_unlock_profiled(pthread_mutex_t *mutex) {
+    struct lock_thread *self = lock_thread_self();
+    uint64_t held = word_now_ns() - self->held_since;
+
+    pthread_mutex_unlock(mutex);
+    self->hold_ns += held;
+    if (held > self->max_hold_ns) {
+        self->max_hold_ns = held;
+    }
+}
+
+void word_lock_stats_print(FILE *outfile) {
+    struct lock_thread total = {0};
+    struct lock_thread *lt;
+
+    if (!word_lock_stats_enabled || lock_threads == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&totals_lock);
+    fprintf(outfile, "--- lock stats ---\n");
+    fprintf(outfile, "%-7s %12s %12s %12s %12s %14s\n", "thread", "acquired",
+            "contended", "wait(ms)", "hold(ms)", "max hold(us)");
+    for (lt = lock_threads; lt != NULL; lt = lt->next) {
+        fprintf(outfile, "%-7d %12llu %12llu %12.3f %12.3f %14.3f\n", lt->id,
+                (unsigned long long) lt->acquisitions,
+                (unsigned long long) lt->contended, lt->wait_ns / 1e6,
+                lt->hold_ns / 1e6, lt->max_hold_ns / 1e3);
+        total.acquisitions += lt->acquisitions;
+        total.contended += lt->contended;
+        total.wait_ns += lt->wait_ns;
+        total.hold_ns += lt->hold_ns;
+        if (lt->max_hold_ns > total.max_hold_ns) {
+            total.max_hold_ns = lt->max_hold_ns;
+        }
+    }
+    fprintf(outfile, "%-7s %12llu %12llu %12.3f %12.3f %14.3f\n", "total",
+            (unsigned long long) total.acquisitions,
+            (unsigned long long) total.contended, total.wait_ns / 1e6,
+            total.hold_ns / 1e6, total.max_hold_ns / 1e3);
+    if (total.wait_ns + total.hold_ns != 0) {
+        fprintf(outfile, "waiting: %.1f%% of time spent in the lock\n",
+                100.0 * total.wait_ns / (total.wait_ns + total.hold_ns));
+    }
+    pthread_mutex_unlock(&totals_lock);
+}
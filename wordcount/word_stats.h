@@ -0,0 +1,130 @@
+/*
+ * The word_stats interface provides lightweight per-phase timing and
+ * counters for the word count programs. Collection is off unless a frontend
+ * enables it (--stats); every hook checks word_stats_enabled first, so a
+ * disabled run pays one predictable branch per hook.
+ *
+ * Counters are accumulated in thread-local storage and folded into a global
+ * total by word_stats_flush(), so worker threads never contend on them.
+ */
+
+#ifndef WORD_STATS_H
+#define WORD_STATS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "word_perf.h"
+
+/* Phases of a word count run. */
+enum word_phase {
+    PHASE_READ,     /* Filling input buffers. */
+    PHASE_TOKENIZE, /* Splitting input into lowercased words. */
+    PHASE_LOOKUP,   /* find_word/add_word on the word count list. */
+    PHASE_MERGE,    /* Merging partial results (fwords). */
+    PHASE_SORT,     /* wordcount_sort. */
+    PHASE_OUTPUT,   /* fprint_words. */
+    NUM_PHASES
+};
+
+struct word_stats {
+    uint64_t wall_ns[NUM_PHASES]; /* Wall time, summed over threads. */
+    uint64_t cpu_ns[NUM_PHASES];  /* Thread CPU time, where measured. */
+    uint64_t bytes;               /* Bytes read from input streams. */
+    uint64_t tokens;              /* Words passed to add_word. */
+    uint64_t short_tokens;        /* One-letter words that were dropped. */
+    uint64_t lookups;             /* find_word calls. */
+    uint64_t compares;            /* Key comparisons made by lookups. */
+    uint64_t inserts;             /* New entries created. */
+    uint64_t allocs;              /* Heap allocations (malloc/realloc). */
+    uint64_t perf[NUM_PHASES][NUM_PERF_EVENTS]; /* With --perf. */
+};
+
+/* Per-phase timer started by word_timer_start(). */
+struct word_timer {
+    uint64_t wall;
+    uint64_t cpu;
+    uint64_t perf[NUM_PERF_EVENTS];
+};
+
+extern bool word_stats_enabled;
+extern __thread struct word_stats word_stats_local;
+
+#define WORD_STATS_ADD(FIELD, N)                                               \
+    do {                                                                       \
+        if (word_stats_enabled) {                                              \
+            word_stats_local.FIELD += (N);                                     \
+        }                                                                      \
+    } while (0)
+
+/* Turns collection on and records the start of the run. */
+void word_stats_enable(void);
+
+/* Monotonic wall clock in nanoseconds. */
+uint64_t word_now_ns(void);
+
+/* CPU time used by the calling thread, in nanoseconds. */
+uint64_t word_thread_cpu_ns(void);
+
+/*
+ * Start and stop a timer attributed to PHASE. When tracing, the interval is
+ * also recorded as a span. No-ops when both are disabled.
+ */
+void word_timer_start(struct word_timer *t);
+void word_timer_stop(struct word_timer *t, enum word_phase phase);
+
+/*
+ * Adds the hardware events counted since START, read by word_perf_read, to
+ * SUM. For phases timed without a word_timer.
+ */
+void word_perf_add(uint64_t sum[NUM_PERF_EVENTS],
+                   const uint64_t start[NUM_PERF_EVENTS]);
+
+/* Folds the calling thread's counters into the global totals. */
+void word_stats_flush(void);
+
+/*
+ * Flushes the calling thread and prints a summary of the global totals to
+ * OUTFILE, headed by LABEL. UNIQUE is the number of distinct words in the
+ * final list and TABLE_BYTES the memory it holds (bytes_words).
+ */
+void word_stats_print(FILE *outfile, const char *label, size_t unique,
+                      size_t table_bytes);
+
+/*
+ * Lock contention profiling (--lock-stats). word_mutex_lock/unlock wrap a
+ * pthread mutex; when profiling is on they record, per thread, how many
+ * acquisitions had to wait, the time spent waiting for and holding the lock,
+ * and the longest single hold. When tracing (word_trace.h), each wait for a
+ * contended lock is also recorded as a span.
+ */
+extern bool word_lock_stats_enabled;
+extern bool word_trace_enabled;
+
+void word_lock_stats_enable(void);
+void word_mutex_lock_profiled(pthread_mutex_t *mutex);
+void word_mutex_unlock_profiled(pthread_mutex_t *mutex);
+
+static inline void word_mutex_lock(pthread_mutex_t *mutex) {
+    if (word_lock_stats_enabled || word_trace_enabled) {
+        word_mutex_lock_profiled(mutex);
+    } else {
+        pthread_mutex_lock(mutex);
+    }
+}
+
+static inline void word_mutex_unlock(pthread_mutex_t *mutex) {
+    if (word_lock_stats_enabled) {
+        word_mutex_unlock_profiled(mutex);
+    } else {
+        pthread_mutex_unlock(mutex);
+    }
+}
+
+/* Prints one line per thread that took a profiled lock, plus totals. */
+void word_lock_stats_print(FILE *outfile);
+
+#endif /* WORD_STATS_H */
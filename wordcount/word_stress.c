@@ -0,0 +1,287 @@
+/*
+ * Contention stress test and benchmark of the word count lists pwords can
+ * use (stress_pwords). --backend picks the backend, as in pwords, and
+ * defaults to pwords' locked one; the others are serialized by the registry.
+ *
+ * For 1, 2, 4, ... up to -T threads, every thread counts its own seeded Zipf
+ * stream of words into one shared list at the same time, with find_or_insert
+ * or, with -b, add_words_batch. The streams together always hold -o words,
+ * so the runs do the same work. Afterwards every count in the list is
+ * checked against a single-threaded tally of the streams, and the run is
+ * reported with its throughput, speedup over one thread and latency
+ * percentiles per call. Exits with 1 if any count is wrong.
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "word_backend.h"
+#include "word_count.h"
+#include "word_hash.h"
+#include "word_keys.h"
+#include "word_stats.h"
+
+#ifndef WORD_REGISTRY
+#error "WORD_REGISTRY must be #define'd when compiling word_stress.c"
+#endif
+
+/* Settings, from the command line. */
+static int max_threads;      /* -T, default twice the CPUs and at least 4 */
+static size_t vocab = 1000;  /* -k: distinct words */
+static size_t ops = 200000;  /* -o: words counted by all threads together */
+static double zipf_s = 1.0;  /* -z */
+static size_t batch = 1;     /* -b: words per call */
+static uint64_t seed = 1;    /* -s */
+static const char *backend;  /* --backend */
+
+enum { OPT_BACKEND = 256 };
+
+static const struct option long_options[] = {
+    {"backend", required_argument, NULL, OPT_BACKEND},
+    {NULL, 0, NULL, 0},
+};
+
+struct worker {
+    pthread_t thread;
+    word_count_list_t *wclist;
+    const word_token_t *tokens; /* One per vocabulary word. */
+    pthread_barrier_t *barrier;
+    size_t *stream;             /* Vocabulary indices to count. */
+    size_t n;
+    uint64_t *latency;          /* ns of each call. */
+    size_t calls;
+    uint64_t start, end;
+};
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    word_token_t pending[batch];
+    size_t i, j;
+
+    pthread_barrier_wait(w->barrier);
+    w->start = word_now_ns();
+    for (i = 0; i < w->n; i += batch) {
+        size_t m = w->n - i < batch ? w->n - i : batch;
+        uint64_t t0;
+        for (j = 0; j < m; j++) {
+            pending[j] = w->tokens[w->stream[i + j]];
+        }
+        t0 = word_now_ns();
+        if (m == 1) {
+            find_or_insert(w->wclist, &pending[0], 1);
+        } else {
+            add_words_batch(w->wclist, pending, m);
+        }
+        w->latency[w->calls++] = word_now_ns() - t0;
+    }
+    w->end = word_now_ns();
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Returns the Pth percentile of the N sorted samples. */
+static uint64_t percentile(const uint64_t *sorted, size_t n, double p) {
+    size_t i = (size_t) (p / 100 * n);
+    return sorted[i < n ? i : n - 1];
+}
+
+/*
+ * Counts with NTHREADS threads and checks the result. Returns false if the
+ * list's counts differ from the streams'. *MOPS is set to the throughput.
+ */
+static bool run(int nthreads, char **words, const word_token_t *tokens,
+                const struct word_zipf *zipf, double *mops, double base) {
+    word_count_list_t wclist;
+    struct worker workers[nthreads];
+    pthread_barrier_t barrier;
+    size_t *expected = calloc(vocab, sizeof(size_t));
+    uint64_t *samples, first = UINT64_MAX, last = 0;
+    size_t nsamples = 0, distinct = 0, wrong = 0, i;
+    int t;
+
+    if (expected == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    init_words(&wclist);
+    pthread_barrier_init(&barrier, NULL, nthreads);
+    for (t = 0; t < nthreads; t++) {
+        struct worker *w = &workers[t];
+        struct word_rng rng;
+        memset(w, 0, sizeof(*w));
+        w->wclist = &wclist;
+        w->tokens = tokens;
+        w->barrier = &barrier;
+        w->n = ops / nthreads + ((size_t) t < ops % nthreads);
+        w->stream = malloc(w->n * sizeof(size_t));
+        w->latency = malloc((w->n / batch + 1) * sizeof(uint64_t));
+        if (w->stream == NULL || w->latency == NULL) {
+            perror("malloc");
+            exit(1);
+        }
+        /* The single-threaded reference tallies the streams as drawn. */
+        word_rng_seed(&rng, seed * 1000003 + t);
+        for (i = 0; i < w->n; i++) {
+            w->stream[i] = word_zipf_draw(zipf, &rng);
+            expected[w->stream[i]]++;
+        }
+    }
+    for (t = 0; t < nthreads; t++) {
+        if (pthread_create(&workers[t].thread, NULL, worker_main,
+                           &workers[t]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    for (t = 0; t < nthreads; t++) {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&barrier);
+
+    /* Every expected word with its exact count, and nothing else. */
+    for (i = 0; i < vocab; i++) {
+        int count = word_backend_count(&wclist, words[i]);
+        if (expected[i] != 0) {
+            distinct++;
+        }
+        if ((size_t) count != expected[i]) {
+            wrong++;
+        }
+    }
+    if (len_words(&wclist) != distinct) {
+        wrong++;
+    }
+
+    for (t = 0; t < nthreads; t++) {
+        nsamples += workers[t].calls;
+    }
+    if ((samples = malloc(nsamples * sizeof(uint64_t))) == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    nsamples = 0;
+    for (t = 0; t < nthreads; t++) {
+        struct worker *w = &workers[t];
+        memcpy(samples + nsamples, w->latency, w->calls * sizeof(uint64_t));
+        nsamples += w->calls;
+        first = w->start < first ? w->start : first;
+        last = w->end > last ? w->end : last;
+        free(w->stream);
+        free(w->latency);
+    }
+    qsort(samples, nsamples, sizeof(uint64_t), compare_u64);
+    *mops = ops * 1e3 / (last - first);
+    printf("%7d %9.2f %8.2f %8lu %8lu %8lu %8lu %9lu  %s\n", nthreads, *mops,
+           base > 0 ? *mops / base : 1.0,
+           (unsigned long) percentile(samples, nsamples, 50),
+           (unsigned long) percentile(samples, nsamples, 90),
+           (unsigned long) percentile(samples, nsamples, 99),
+           (unsigned long) percentile(samples, nsamples, 99.9),
+           (unsigned long) samples[nsamples - 1],
+           wrong == 0 ? "ok" : "WRONG COUNTS");
+    fflush(stdout);
+    free(samples);
+    free(expected);
+    /* The word_count interface cannot free a list; each run leaks one. */
+    return wrong == 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s [-T MAX_THREADS] [-k VOCAB] [-o OPS] [-z S] [-b BATCH] "
+            "[-s SEED]\n"
+            "       [--backend=NAME]\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    struct word_rng rng;
+    struct word_zipf *zipf;
+    word_token_t *tokens;
+    char **words;
+    double mops, base = 0;
+    bool ok = true;
+    int opt, t;
+    size_t i;
+
+    max_threads = 2 * sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 4) {
+        max_threads = 4;
+    }
+    while ((opt = getopt_long(argc, argv, "T:k:o:z:b:s:", long_options,
+                              NULL)) != -1) {
+        switch (opt) {
+        case 'T':
+            max_threads = atoi(optarg);
+            break;
+        case 'k':
+            vocab = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            ops = strtoul(optarg, NULL, 10);
+            break;
+        case 'z':
+            zipf_s = atof(optarg);
+            break;
+        case 'b':
+            batch = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 10);
+            break;
+        case OPT_BACKEND:
+            backend = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc || max_threads <= 0 || vocab == 0 || ops == 0 ||
+        zipf_s <= 0 || batch == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!word_backend_select(argv[0], backend, "locked")) {
+        return 1;
+    }
+
+    word_rng_seed(&rng, seed);
+    words = word_keys_make(&rng, vocab, 3, 12);
+    zipf = word_zipf_new(vocab, zipf_s);
+    if ((tokens = malloc(vocab * sizeof(word_token_t))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    for (i = 0; i < vocab; i++) {
+        size_t len = strlen(words[i]);
+        tokens[i] = (word_token_t){words[i], len, word_hash(words[i], len)};
+    }
+
+    printf("%s backend: %zu words of a Zipf(%.2f) vocabulary of %zu, %zu per "
+           "call; latency in ns per call\n",
+           word_backend->name, ops, zipf_s, vocab, batch);
+    printf("%7s %9s %8s %8s %8s %8s %8s %9s  %s\n", "threads", "Mwords/s",
+           "speedup", "p50", "p90", "p99", "p99.9", "max", "counts");
+    for (t = 1; t <= max_threads; t = t < max_threads && 2 * t > max_threads
+                                            ? max_threads
+                                            : 2 * t) {
+        ok &= run(t, words, tokens, zipf, &mops, base);
+        if (t == 1) {
+            base = mops;
+        }
+    }
+
+    free(tokens);
+    word_zipf_free(zipf);
+    word_keys_free(words, vocab);
+    return ok ? 0 : 1;
+}
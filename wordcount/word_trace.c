@@ -0,0 +1,173 @@
+/*
+ * Implementation of the word_trace interface.
+ */
+
+#include "word_trace.h"
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* Spans per chunk of a thread's buffer. */
+#define TRACE_CHUNK 4096
+
+struct trace_span {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct trace_chunk {
+    struct trace_chunk *next;
+    size_t n;
+    struct trace_span spans[TRACE_CHUNK];
+};
+
+/* A thread's buffer. Buffers live until exit, past their threads. */
+struct trace_thread {
+    struct trace_thread *next;
+    int tid;
+    char name[32];
+    struct trace_chunk *head;
+    struct trace_chunk *tail;
+    size_t dropped; /* Spans lost because a chunk could not be allocated. */
+};
+
+bool word_trace_enabled = false;
+
+static const char *trace_path;
+static int child_index = -1;
+static uint64_t start_ns;
+
+static struct trace_thread *threads;
+static int next_tid = 1;
+static __thread struct trace_thread *self;
+
+void word_trace_enable(const char *path) {
+    word_trace_enabled = true;
+    trace_path = path;
+    start_ns = word_now_ns();
+    word_trace_thread("main");
+}
+
+/* Returns the calling thread's buffer, linking a new one in if needed. */
+static struct trace_thread *trace_self(void) {
+    struct trace_thread *t = self;
+
+    if (t != NULL) {
+        return t;
+    }
+    if ((t = calloc(1, sizeof(*t))) == NULL) {
+        return NULL;
+    }
+    t->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+    snprintf(t->name, sizeof(t->name), "thread %d", t->tid);
+    t->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&threads, &t->next, t, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    self = t;
+    return t;
+}
+
+void word_trace_thread(const char *fmt, ...) {
+    struct trace_thread *t;
+    va_list ap;
+
+    if (!word_trace_enabled || (t = trace_self()) == NULL) {
+        return;
+    }
+    va_start(ap, fmt);
+    vsnprintf(t->name, sizeof(t->name), fmt, ap);
+    va_end(ap);
+}
+
+void word_trace_record(const char *name, uint64_t start, uint64_t end) {
+    struct trace_thread *t = trace_self();
+    struct trace_chunk *c;
+
+    if (t == NULL) {
+        return;
+    }
+    c = t->tail;
+    if (c == NULL || c->n == TRACE_CHUNK) {
+        if ((c = malloc(sizeof(*c))) == NULL) {
+            t->dropped++;
+            return;
+        }
+        c->next = NULL;
+        c->n = 0;
+        if (t->tail == NULL) {
+            t->head = c;
+        } else {
+            t->tail->next = c;
+        }
+        t->tail = c;
+    }
+    c->spans[c->n++] = (struct trace_span){name, start, end};
+}
+
+void word_trace_child(int index) {
+    child_index = index;
+}
+
+void word_trace_write(void) {
+    char path[PATH_MAX];
+    struct trace_thread *t;
+    struct trace_chunk *c;
+    size_t spans = 0, dropped = 0, i;
+    int nthreads = 0, pid = getpid();
+    const char *sep = "";
+    FILE *out;
+
+    if (!word_trace_enabled) {
+        return;
+    }
+    if (child_index >= 0) {
+        snprintf(path, sizeof(path), "%s.%d", trace_path, child_index);
+    } else {
+        snprintf(path, sizeof(path), "%s", trace_path);
+    }
+    if ((out = fopen(path, "w")) == NULL) {
+        perror(path);
+        return;
+    }
+
+    /* Times are in microseconds from the start of the run. */
+    fprintf(out, "{\"traceEvents\":[\n");
+    for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL;
+         t = t->next) {
+        fprintf(out,
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                sep, pid, t->tid, t->name);
+        sep = ",\n";
+        for (c = t->head; c != NULL; c = c->next) {
+            for (i = 0; i < c->n; i++) {
+                const struct trace_span *s = &c->spans[i];
+                fprintf(out,
+                        ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,"
+                        "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        s->name, pid, t->tid,
+                        (double) (s->start - start_ns) / 1e3,
+                        (double) (s->end - s->start) / 1e3);
+            }
+            spans += c->n;
+        }
+        dropped += t->dropped;
+        nthreads++;
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+    if (fclose(out) != 0) {
+        perror(path);
+        return;
+    }
+    fprintf(stderr, "trace: %zu spans from %d thread%s written to %s", spans,
+            nthreads, nthreads == 1 ? "" : "s", path);
+    if (dropped != 0) {
+        fprintf(stderr, " (%zu dropped)", dropped);
+    }
+    fprintf(stderr, "\n");
+}
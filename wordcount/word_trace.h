@@ -0,0 +1,56 @@
+/*
+ * The word_trace interface records a timeline of what every thread did
+ * (--trace=FILE) and writes it as Chrome trace events, for chrome://tracing
+ * or Perfetto.
+ *
+ * A span is a name and the start and end of an interval on the calling
+ * thread. Each thread appends its spans to a buffer of its own, grown a chunk
+ * at a time, so recording takes no lock and touches no shared cache line;
+ * only a thread's first span links its buffer into the list of threads, with
+ * one compare-and-swap. The word_timer phases (read, tokenize, insert, merge,
+ * sort, output) become spans by themselves; frontends add file opens, and
+ * word_mutex_lock adds the time spent waiting for a contended lock.
+ */
+
+#ifndef WORD_TRACE_H
+#define WORD_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "word_stats.h"
+
+/* Turns tracing on; word_trace_write writes to PATH. */
+void word_trace_enable(const char *path);
+
+/* Names the calling thread in the trace, printf-style. */
+void word_trace_thread(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/*
+ * Records span NAME, from START to END in word_now_ns time, on the calling
+ * thread. NAME is kept, not copied, so it must be a string literal.
+ */
+void word_trace_record(const char *name, uint64_t start, uint64_t end);
+
+/* Returns the start of a span to pass to word_trace_end, or 0 if disabled. */
+static inline uint64_t word_trace_begin(void) {
+    return word_trace_enabled ? word_now_ns() : 0;
+}
+
+static inline void word_trace_end(const char *name, uint64_t start) {
+    if (word_trace_enabled) {
+        word_trace_record(name, start, word_now_ns());
+    }
+}
+
+/* In a child made by fork: the trace goes to FILE.INDEX. */
+void word_trace_child(int index);
+
+/*
+ * Writes every thread's spans to the trace file. Call once the threads are
+ * done recording.
+ */
+void word_trace_write(void);
+
+#endif /* WORD_TRACE_H */
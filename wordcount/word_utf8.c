@@ -0,0 +1,175 @@
+/*
+ * Implementation of the word_utf8 interface.
+ */
+
+#include "word_utf8.h"
+
+/* How a range of letters folds to lower case. */
+enum fold {
+    FOLD_NONE,      /* Already folded, or caseless. */
+    FOLD_DELTA,     /* Add delta. */
+    FOLD_EVEN_ODD,  /* Even code points are upper case of the next one. */
+    FOLD_ODD_EVEN,  /* Odd code points are upper case of the next one. */
+};
+
+struct letter_range {
+    uint32_t lo;
+    uint32_t hi;
+    enum fold fold;
+    int32_t delta;
+};
+
+/* Letter ranges, sorted and disjoint. */
+static const struct letter_range ranges[] = {
+    {0x00aa, 0x00aa, FOLD_NONE, 0},
+    {0x00b5, 0x00b5, FOLD_DELTA, 0x03bc - 0x00b5}, /* micro -> mu */
+    {0x00ba, 0x00ba, FOLD_NONE, 0},
+    {0x00c0, 0x00d6, FOLD_DELTA, 0x20},
+    {0x00d8, 0x00de, FOLD_DELTA, 0x20},
+    {0x00df, 0x00f6, FOLD_NONE, 0},
+    {0x00f8, 0x00ff, FOLD_NONE, 0},
+    {0x0100, 0x012f, FOLD_EVEN_ODD, 0},
+    {0x0130, 0x0130, FOLD_DELTA, 'i' - 0x0130},
+    {0x0131, 0x0131, FOLD_NONE, 0},
+    {0x0132, 0x0137, FOLD_EVEN_ODD, 0},
+    {0x0138, 0x0138, FOLD_NONE, 0},
+    {0x0139, 0x0148, FOLD_ODD_EVEN, 0},
+    {0x0149, 0x0149, FOLD_NONE, 0},
+    {0x014a, 0x0177, FOLD_EVEN_ODD, 0},
+    {0x0178, 0x0178, FOLD_DELTA, 0x00ff - 0x0178},
+    {0x0179, 0x017e, FOLD_ODD_EVEN, 0},
+    {0x017f, 0x017f, FOLD_DELTA, 's' - 0x017f},
+    /* Latin Extended-B: pairs, with capitals of IPA letters in between. */
+    {0x0180, 0x0180, FOLD_NONE, 0},
+    {0x0181, 0x0181, FOLD_DELTA, 0x0253 - 0x0181},
+    {0x0182, 0x0185, FOLD_EVEN_ODD, 0},
+    {0x0186, 0x0186, FOLD_DELTA, 0x0254 - 0x0186},
+    {0x0187, 0x0188, FOLD_ODD_EVEN, 0},
+    {0x0189, 0x018a, FOLD_DELTA, 0x0256 - 0x0189},
+    {0x018b, 0x018c, FOLD_ODD_EVEN, 0},
+    {0x018d, 0x018d, FOLD_NONE, 0},
+    {0x018e, 0x018e, FOLD_DELTA, 0x01dd - 0x018e},
+    {0x018f, 0x018f, FOLD_DELTA, 0x0259 - 0x018f},
+    {0x0190, 0x0190, FOLD_DELTA, 0x025b - 0x0190},
+    {0x0191, 0x0192, FOLD_ODD_EVEN, 0},
+    {0x0193, 0x0193, FOLD_DELTA, 0x0260 - 0x0193},
+    {0x0194, 0x0194, FOLD_DELTA, 0x0263 - 0x0194},
+    {0x0195, 0x0195, FOLD_NONE, 0},
+    {0x0196, 0x0196, FOLD_DELTA, 0x0269 - 0x0196},
+    {0x0197, 0x0197, FOLD_DELTA, 0x0268 - 0x0197},
+    {0x0198, 0x0199, FOLD_EVEN_ODD, 0},
+    {0x019a, 0x019b, FOLD_NONE, 0},
+    {0x019c, 0x019c, FOLD_DELTA, 0x026f - 0x019c},
+    {0x019d, 0x019d, FOLD_DELTA, 0x0272 - 0x019d},
+    {0x019e, 0x019e, FOLD_NONE, 0},
+    {0x019f, 0x019f, FOLD_DELTA, 0x0275 - 0x019f},
+    {0x01a0, 0x01a5, FOLD_EVEN_ODD, 0},
+    {0x01a6, 0x01a6, FOLD_DELTA, 0x0280 - 0x01a6},
+    {0x01a7, 0x01a8, FOLD_ODD_EVEN, 0},
+    {0x01a9, 0x01a9, FOLD_DELTA, 0x0283 - 0x01a9},
+    {0x01aa, 0x01ab, FOLD_NONE, 0},
+    {0x01ac, 0x01ad, FOLD_EVEN_ODD, 0},
+    {0x01ae, 0x01ae, FOLD_DELTA, 0x0288 - 0x01ae},
+    {0x01af, 0x01b0, FOLD_ODD_EVEN, 0},
+    {0x01b1, 0x01b2, FOLD_DELTA, 0x028a - 0x01b1},
+    {0x01b3, 0x01b6, FOLD_ODD_EVEN, 0},
+    {0x01b7, 0x01b7, FOLD_DELTA, 0x0292 - 0x01b7},
+    {0x01b8, 0x01b9, FOLD_EVEN_ODD, 0},
+    {0x01ba, 0x01bb, FOLD_NONE, 0},
+    {0x01bc, 0x01bd, FOLD_EVEN_ODD, 0},
+    {0x01be, 0x01c3, FOLD_NONE, 0},
+    {0x01c4, 0x01c4, FOLD_DELTA, 2},
+    {0x01c5, 0x01c6, FOLD_ODD_EVEN, 0},
+    {0x01c7, 0x01c7, FOLD_DELTA, 2},
+    {0x01c8, 0x01c9, FOLD_EVEN_ODD, 0},
+    {0x01ca, 0x01ca, FOLD_DELTA, 2},
+    {0x01cb, 0x01dc, FOLD_ODD_EVEN, 0},
+    {0x01dd, 0x01dd, FOLD_NONE, 0},
+    {0x01de, 0x01ef, FOLD_EVEN_ODD, 0},
+    {0x01f0, 0x01f0, FOLD_NONE, 0},
+    {0x01f1, 0x01f1, FOLD_DELTA, 2},
+    {0x01f2, 0x01f5, FOLD_EVEN_ODD, 0},
+    {0x01f6, 0x01f6, FOLD_DELTA, 0x0195 - 0x01f6},
+    {0x01f7, 0x01f7, FOLD_DELTA, 0x01bf - 0x01f7},
+    {0x01f8, 0x021f, FOLD_EVEN_ODD, 0},
+    {0x0220, 0x0220, FOLD_DELTA, 0x019e - 0x0220},
+    {0x0221, 0x0221, FOLD_NONE, 0},
+    {0x0222, 0x0233, FOLD_EVEN_ODD, 0},
+    {0x0234, 0x0239, FOLD_NONE, 0},
+    {0x023a, 0x023a, FOLD_DELTA, 0x2c65 - 0x023a},
+    {0x023b, 0x023c, FOLD_ODD_EVEN, 0},
+    {0x023d, 0x023d, FOLD_DELTA, 0x019a - 0x023d},
+    {0x023e, 0x023e, FOLD_DELTA, 0x2c66 - 0x023e},
+    {0x023f, 0x0240, FOLD_NONE, 0},
+    {0x0241, 0x0242, FOLD_ODD_EVEN, 0},
+    {0x0243, 0x0243, FOLD_DELTA, 0x0180 - 0x0243},
+    {0x0244, 0x0244, FOLD_DELTA, 0x0289 - 0x0244},
+    {0x0245, 0x0245, FOLD_DELTA, 0x028c - 0x0245},
+    {0x0246, 0x024f, FOLD_EVEN_ODD, 0},
+    {0x0250, 0x02af, FOLD_NONE, 0}, /* IPA */
+    /* Combining diacritical marks, so decomposed accents stay in the word. */
+    {0x0300, 0x0344, FOLD_NONE, 0},
+    {0x0345, 0x0345, FOLD_DELTA, 0x03b9 - 0x0345}, /* ypogegrammeni */
+    {0x0346, 0x036f, FOLD_NONE, 0},
+    {0x0370, 0x0373, FOLD_EVEN_ODD, 0},
+    {0x0376, 0x0377, FOLD_EVEN_ODD, 0},
+    {0x037b, 0x037d, FOLD_NONE, 0},
+    {0x0386, 0x0386, FOLD_DELTA, 0x03ac - 0x0386},
+    {0x0388, 0x038a, FOLD_DELTA, 0x03ad - 0x0388},
+    {0x038c, 0x038c, FOLD_DELTA, 0x03cc - 0x038c},
+    {0x038e, 0x038f, FOLD_DELTA, 0x03cd - 0x038e},
+    {0x0390, 0x0390, FOLD_NONE, 0},
+    {0x0391, 0x03a1, FOLD_DELTA, 0x20},
+    {0x03a3, 0x03ab, FOLD_DELTA, 0x20},
+    {0x03ac, 0x03c1, FOLD_NONE, 0},
+    {0x03c2, 0x03c2, FOLD_DELTA, 1}, /* final sigma */
+    {0x03c3, 0x03ce, FOLD_NONE, 0},
+    {0x03d8, 0x03ef, FOLD_EVEN_ODD, 0},
+    {0x0400, 0x040f, FOLD_DELTA, 0x50},
+    {0x0410, 0x042f, FOLD_DELTA, 0x20},
+    {0x0430, 0x045f, FOLD_NONE, 0},
+    {0x0460, 0x0481, FOLD_EVEN_ODD, 0},
+    {0x048a, 0x04bf, FOLD_EVEN_ODD, 0},
+    {0x04c0, 0x04c0, FOLD_DELTA, 0x04cf - 0x04c0},
+    {0x04c1, 0x04ce, FOLD_ODD_EVEN, 0},
+    {0x04cf, 0x04cf, FOLD_NONE, 0},
+    {0x04d0, 0x052f, FOLD_EVEN_ODD, 0},
+    {0x0531, 0x0556, FOLD_DELTA, 0x30},
+    {0x0561, 0x0587, FOLD_NONE, 0},
+    {0x05d0, 0x05ea, FOLD_NONE, 0},
+    {0x0620, 0x064a, FOLD_NONE, 0},
+    {0x1e00, 0x1e95, FOLD_EVEN_ODD, 0},
+    {0x1e96, 0x1e9d, FOLD_NONE, 0},
+    {0x1e9e, 0x1e9e, FOLD_DELTA, 0x00df - 0x1e9e}, /* capital sharp s */
+    {0x1ea0, 0x1eff, FOLD_EVEN_ODD, 0},
+    {0x3041, 0x3096, FOLD_NONE, 0}, /* Hiragana */
+    {0x30a1, 0x30fa, FOLD_NONE, 0}, /* Katakana */
+    {0x4e00, 0x9fff, FOLD_NONE, 0}, /* CJK unified ideographs */
+    {0xac00, 0xd7a3, FOLD_NONE, 0}, /* Hangul syllables */
+};
+
+uint32_t utf8_fold(uint32_t cp) {
+    size_t lo = 0, hi = sizeof(ranges) / sizeof(ranges[0]);
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const struct letter_range *r = &ranges[mid];
+        if (cp < r->lo) {
+            hi = mid;
+        } else if (cp > r->hi) {
+            lo = mid + 1;
+        } else {
+            switch (r->fold) {
+            case FOLD_DELTA:
+                return cp + r->delta;
+            case FOLD_EVEN_ODD:
+                return cp | 1;
+            case FOLD_ODD_EVEN:
+                return cp + ((cp - r->lo) % 2 == 0 ? 1 : 0);
+            default:
+                return cp;
+            }
+        }
+    }
+    return 0;
+}
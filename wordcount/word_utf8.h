@@ -0,0 +1,45 @@
+/*
+ * The word_utf8 interface classifies and case-folds Unicode letters for the
+ * UTF-8 tokenizer of count_words.
+ */
+
+#ifndef WORD_UTF8_H
+#define WORD_UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Returns the simple case folding of code point CP if it is a letter or a
+ * combining diacritical mark (U+0300-U+036F), or 0 if it is neither. Covers
+ * Latin up to Latin Extended-B, IPA, Greek, Cyrillic, Armenian, Hebrew,
+ * Arabic, Latin Extended Additional, kana, CJK ideographs and Hangul
+ * syllables. Marks count as letters so that a word in decomposed form (NFD)
+ * is not split at its accents; words in NFC and NFD are still counted apart.
+ */
+uint32_t utf8_fold(uint32_t cp);
+
+/* Writes CP as UTF-8 to OUT, which must have room for 4 bytes. Returns the
+ * number of bytes written. */
+static inline size_t utf8_encode(uint32_t cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    } else if (cp < 0x800) {
+        out[0] = 0xc0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    } else if (cp < 0x10000) {
+        out[0] = 0xe0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3f);
+    out[2] = 0x80 | ((cp >> 6) & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+#endif /* WORD_UTF8_H */
@@ -29,8 +29,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "word_aio.h"
 #include "word_count.h"
 #include "word_helpers.h"
+#include "word_hll.h"
+#include "word_options.h"
+#include "word_progress.h"
+#include "word_stats.h"
+#include "word_trace.h"
+
+#ifdef WORD_REGISTRY
+#include "word_backend.h"
+#endif
+
+#if defined(ART_TREE) || defined(WORD_REGISTRY)
+static void print_entry(const word_count_t *wc, void *outfile) {
+    fprintf(outfile, "%8d\t%s\n", wc->count, wc_word(wc));
+}
+#endif
 
 /*
  * main - handle command line and file handles.
@@ -38,14 +54,69 @@
 int main(int argc, char *argv[]) {
     /* Create the empty data structure. */
     word_count_list_t word_counts;
+    struct word_timer t;
+    int first;
+
+    if ((first = word_options_parse(argc, argv)) < 0) {
+        return 1;
+    }
+#ifdef WORD_REGISTRY
+    if (!word_backend_select(argv[0], word_options_backend, "list")) {
+        return 1;
+    }
+#else
+    if (word_options_backend != NULL) {
+        fprintf(stderr, "%s: --backend is only supported by words, pwords "
+                        "and fwords\n",
+                argv[0]);
+        return 1;
+    }
+#endif
     init_words(&word_counts);
+    if (word_options_pipeline.readers > 0) {
+        fprintf(stderr, "%s: --pipeline is only supported by pwords\n",
+                argv[0]);
+        return 1;
+    }
+    if (word_options_numa) {
+        fprintf(stderr, "%s: --numa is only supported by pwords\n", argv[0]);
+        return 1;
+    }
+#if defined(WORD_REGISTRY)
+    if (word_options_prefix != NULL && !word_backend_has_prefix(&word_counts)) {
+        fprintf(stderr, "%s: --prefix needs the radix tree backend "
+                        "(--backend=art)\n",
+                argv[0]);
+        return 1;
+    }
+#elif !defined(ART_TREE)
+    if (word_options_prefix != NULL) {
+        fprintf(stderr, "%s: --prefix needs the radix tree backend (awords)\n",
+                argv[0]);
+        return 1;
+    }
+#endif
 
-    if (argc <= 1) {
+    word_progress_begin(argv + first, argc - first);
+    word_progress_watch(&word_counts, 1);
+    if (first >= argc) {
         count_words(&word_counts, stdin);
+    } else if (word_options_aio >= 0) {
+        /* Read ahead of the tokenizer, across files. */
+        struct word_aio *aio = word_aio_start(argv + first, argc - first, 1);
+        int file;
+        if (aio == NULL) {
+            return 1;
+        }
+        while ((file = word_aio_claim(aio)) >= 0) {
+            count_words_source(&word_counts, word_aio_source(aio, file));
+            word_hll_print_input(stderr, argv[first + file]);
+        }
+        word_aio_finish(aio);
     } else {
         /* Process each file. */
         int i;
-        for (i = 1; i < argc; i++) {
+        for (i = first; i < argc; i++) {
             FILE *infile = fopen(argv[i], "r");
             if (infile == NULL) {
                 perror("fopen");
@@ -53,11 +124,35 @@ int main(int argc, char *argv[]) {
             }
             count_words(&word_counts, infile);
             fclose(infile);
+            word_hll_print_input(stderr, argv[i]);
         }
     }
+    word_progress_end();
+
+#if defined(ART_TREE) || defined(WORD_REGISTRY)
+    if (word_options_prefix != NULL) {
+        /* Prefix queries come out in alphabetical order without sorting. */
+        word_timer_start(&t);
+        prefix_words(&word_counts, word_options_prefix, print_entry, stdout);
+        word_timer_stop(&t, PHASE_OUTPUT);
+        word_stats_print(stderr, argv[0], len_words(&word_counts),
+                         bytes_words(&word_counts));
+        word_hll_print_total(stderr, len_words(&word_counts));
+        word_trace_write();
+        return 0;
+    }
+#endif /* ART_TREE || WORD_REGISTRY */
 
     /* Output final result. */
+    word_timer_start(&t);
     wordcount_sort(&word_counts, less_count);
+    word_timer_stop(&t, PHASE_SORT);
+    word_timer_start(&t);
     fprint_words(&word_counts, stdout);
+    word_timer_stop(&t, PHASE_OUTPUT);
+    word_stats_print(stderr, argv[0], len_words(&word_counts),
+                     bytes_words(&word_counts));
+    word_hll_print_total(stderr, len_words(&word_counts));
+    word_trace_write();
     return 0;
 }